@@ -0,0 +1,71 @@
+// Pairs of functions compiled by codegen_check.py: every cpplinq_<name>
+// should compile to the same loop as hand_<name>.
+#define USE_CPPLINQ_MACRO
+#include "cpplinq.h"
+
+#include <vector>
+
+extern "C"
+{
+int cpplinq_sum(const std::vector<int>& values)
+{
+    return FROM (values) SUM ();
+}
+
+int hand_sum(const std::vector<int>& values)
+{
+    int sum = 0;
+    for (int o : values)
+    {
+        sum += o;
+    }
+    return sum;
+}
+
+int cpplinq_where_sum(const std::vector<int>& values)
+{
+    return FROM (values) WHERE (o % 3 == 0) SUM ();
+}
+
+int hand_where_sum(const std::vector<int>& values)
+{
+    int sum = 0;
+    for (int o : values)
+    {
+        if (o % 3 == 0)
+            sum += o;
+    }
+    return sum;
+}
+
+size_t cpplinq_count(const std::vector<int>& values)
+{
+    return FROM (values) COUNT ();
+}
+
+size_t hand_count(const std::vector<int>& values)
+{
+    size_t count = 0;
+    for (auto it = values.begin(); it != values.end(); ++it)
+    {
+        count++;
+    }
+    return count;
+}
+
+size_t cpplinq_where_count(const std::vector<int>& values)
+{
+    return FROM (values) WHERE (o % 3 == 0) COUNT ();
+}
+
+size_t hand_where_count(const std::vector<int>& values)
+{
+    size_t count = 0;
+    for (int o : values)
+    {
+        if (o % 3 == 0)
+            count++;
+    }
+    return count;
+}
+}
@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+
+# Compiles codegen/pipelines.cpp to assembly and compares every cpplinq_<name>
+# function with hand_<name>: the cpplinq pipeline should inline every cpplinq
+# function it uses, should not call its condition through a pointer and
+# should vectorize when the hand-written loop does. Exits non-zero when one
+# does not.
+#
+# usage: codegen_check.py [compiler] [flags...]    (default: c++ -O2)
+
+import os
+import re
+import subprocess
+import sys
+
+here = os.path.dirname(os.path.abspath(__file__))
+compiler = sys.argv[1] if len(sys.argv) > 1 else "c++"
+flags = sys.argv[2:] if len(sys.argv) > 2 else ["-O2"]
+
+assembly = subprocess.check_output(
+    [compiler, "-std=gnu++17", "-S", "-o", "-", "-I" + os.path.join(here, "..", "include")] + flags +
+    [os.path.join(here, "codegen", "pipelines.cpp")]).decode()
+
+functions = {}
+name = None
+for line in assembly.splitlines():
+    label = re.match(r"^([A-Za-z_.$][\w.$@]*):", line)
+    if label and not label.group(1).startswith("."):
+        name = label.group(1)
+        functions[name] = []
+    elif name and re.match(r"^\s+[a-z]", line) and not re.match(r"^\s+\.", line):
+        functions[name].append(line.strip())
+
+def demangle(symbol):
+    try:
+        return subprocess.check_output(["c++filt", symbol]).decode().strip()
+    except OSError:
+        return symbol
+
+def shorten(text):
+    return text if len(text) <= 150 else text[:147] + "..."
+
+def callees(body):
+    for instruction in body:
+        target = re.match(r"(?:call|jmp)q?\s+([A-Za-z_][\w.$]*)", instruction)
+        if target:
+            yield target.group(1).split("@")[0]
+
+# The function and the cpplinq functions it reaches that were not inlined.
+def reachable(root):
+    seen = [root]
+    for function in seen:
+        for callee in callees(functions.get(function, [])):
+            if callee in functions and callee not in seen and "3zen" in callee:
+                seen.append(callee)
+    return seen
+
+vector = re.compile(r"^v?p(add|sub|mul|cmp|and|or)[a-z]*\s|%[xy]mm.*%[xy]mm")
+
+def vectorized(body):
+    return any(vector.search(instruction) for instruction in body)
+
+failed = False
+for hand in sorted(f for f in functions if f.startswith("hand_")):
+    pipeline = "cpplinq_" + hand[len("hand_"):]
+    if pipeline not in functions:
+        continue
+
+    code = reachable(pipeline)
+    body = [instruction for function in code for instruction in functions[function]]
+    notes = []
+
+    # Calls through a register in the pipeline, or through anything in a
+    # cpplinq function it calls; the pipeline's own calls through memory are
+    # the virtual calls of shared_ptr.
+    indirect = [i for i in functions[pipeline] if re.match(r"(call|jmp)q?\s+\*%", i)]
+    indirect += [i for f in code[1:] for i in functions[f] if re.match(r"(call|jmp)q?\s+\*", i)]
+    if indirect:
+        notes.append("%d indirect calls: a condition called through a pointer, such as DefaultCondition"
+                     % len(indirect))
+
+    invokers = set(c for c in callees(body) if "_FUN" in c and "3zen" in c)
+    for invoker in invokers:
+        notes.append("calls a lambda through the function pointer it converted to, such as DefaultCondition: "
+                     + shorten(demangle(invoker)))
+
+    if vectorized(functions[hand]) and not vectorized(body):
+        notes.append("the hand-written loop is vectorized and the pipeline is not: zen::iterator re-tests "
+                     "m_iter != m_end && !m_condition(*m_iter) on every step")
+
+    outline = [shorten(demangle(f)) for f in code[1:]]
+    if outline:
+        notes.append("%d cpplinq functions were not inlined" % len(outline))
+    print("%-12s %4d instructions (hand-written %d)%s" % (
+        pipeline[len("cpplinq_"):], len(body), len(functions[hand]), ", FAILED" if notes else ", ok"))
+    for note in notes:
+        print("  " + note)
+    for function in outline:
+        print("  not inlined: " + function)
+    failed = failed or bool(notes)
+
+sys.exit(1 if failed else 0)
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "perf_counters.h"
+
+namespace bench
+{
+// Keeps the compiler from dropping a result nobody reads.
+template <typename T>
+void keep(const T& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "g"(&value) : "memory");
+#else
+    static const void* volatile sink;
+    sink = &value;
+#endif
+}
+
+struct Measurement
+{
+    std::string name;
+    std::string implementation;
+    size_t rows = 0;
+    size_t width = 0;
+    double selectivity = 1;
+    size_t runs = 0;
+    double nanoseconds = 0;
+    CounterValues counters;
+
+    double perRow(double total) const
+    {
+        return total / double(rows);
+    }
+};
+
+// Runs prepare and then query, untimed once to warm up and then timed with
+// the counters on, until minNanoseconds have passed. Counts are per run.
+template <typename Prepare, typename Query>
+Measurement measure(PerfCounters& counters, const std::string& name, size_t rows, Prepare prepare, Query query,
+    double minNanoseconds = 2e8)
+{
+    Measurement result;
+    result.name = name;
+    result.rows = rows;
+
+    prepare();
+    keep(query());
+
+    CounterValues totals;
+    while (result.nanoseconds < minNanoseconds)
+    {
+        prepare();
+        counters.start();
+        auto begin = std::chrono::steady_clock::now();
+        keep(query());
+        auto end = std::chrono::steady_clock::now();
+        CounterValues run = counters.stop();
+
+        result.nanoseconds += double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count());
+        for (size_t i = 0; i < CounterCount; i++)
+        {
+            if (run[i])
+                totals.values[i] = totals[i].value_or(0) + *run[i];
+        }
+        result.runs++;
+    }
+
+    result.nanoseconds /= double(result.runs);
+    for (size_t i = 0; i < CounterCount; i++)
+    {
+        if (totals[i] && result.runs != 0)
+            result.counters.values[i] = *totals[i] / double(result.runs);
+    }
+    return result;
+}
+
+template <typename Query>
+Measurement measure(PerfCounters& counters, const std::string& name, size_t rows, Query query)
+{
+    return measure(counters, name, rows, []() {}, query);
+}
+
+inline void printHeader(const PerfCounters& counters)
+{
+    if (!counters.available())
+        std::printf("# hardware counters unavailable (%s), reporting time only\n", counters.reason().c_str());
+    std::printf("%-16s %-8s %11s %6s %6s %10s %12s %12s %8s %12s %12s\n", "query", "impl", "rows", "width", "sel",
+        "ns/row", "cycles/row", "instr/row", "ipc", "llc/row", "brmiss/row");
+}
+
+inline std::optional<double> ipc(const Measurement& m)
+{
+    if (m.counters[Cycles] && m.counters[Instructions] && *m.counters[Cycles] > 0)
+        return *m.counters[Instructions] / *m.counters[Cycles];
+    return std::nullopt;
+}
+
+// Prints one measurement per row processed; n/a marks a missing counter.
+inline void print(const Measurement& m)
+{
+    auto column = [](std::optional<double> value, int width, int precision) {
+        char text[32];
+        if (value)
+            std::snprintf(text, sizeof(text), "%*.*f", width, precision, *value);
+        else
+            std::snprintf(text, sizeof(text), "%*s", width, "n/a");
+        return std::string(text);
+    };
+    auto perRow = [&](std::optional<double> value) -> std::optional<double> {
+        if (value)
+            return m.perRow(*value);
+        return std::nullopt;
+    };
+
+    std::printf("%-16s %-8s %11zu %6zu %6.2f %10.3f %s %s %s %s %s\n", m.name.c_str(), m.implementation.c_str(), m.rows,
+        m.width, m.selectivity, m.perRow(m.nanoseconds), column(perRow(m.counters[Cycles]), 12, 2).c_str(),
+        column(perRow(m.counters[Instructions]), 12, 2).c_str(), column(ipc(m), 8, 2).c_str(),
+        column(perRow(m.counters[LlcMisses]), 12, 4).c_str(), column(perRow(m.counters[BranchMisses]), 12, 4).c_str());
+    std::fflush(stdout);
+}
+
+// Collects the measurements of a run and writes them as CSV or JSON, one
+// record per measurement with every figure per row; a missing counter is an
+// empty CSV field or a JSON null.
+class Report
+{
+public:
+    void add(const Measurement& m)
+    {
+        print(m);
+        m_measurements.push_back(m);
+    }
+
+    const std::vector<Measurement>& measurements() const
+    {
+        return m_measurements;
+    }
+
+    bool writeCsv(const std::string& path) const
+    {
+        std::FILE* file = std::fopen(path.c_str(), "w");
+        if (file == nullptr)
+            return false;
+        std::fputs("query,implementation,rows,width,selectivity,runs,ns_per_row", file);
+        for (size_t i = 0; i < CounterCount; i++)
+        {
+            std::fprintf(file, ",%s_per_row", counterName(i));
+        }
+        std::fputs(",ipc\n", file);
+        for (const auto& m : m_measurements)
+        {
+            std::fprintf(file, "%s,%s,%zu,%zu,%g,%zu,%.6g", m.name.c_str(), m.implementation.c_str(), m.rows, m.width,
+                m.selectivity, m.runs, m.perRow(m.nanoseconds));
+            for (size_t i = 0; i < CounterCount; i++)
+            {
+                if (m.counters[i])
+                    std::fprintf(file, ",%.6g", m.perRow(*m.counters[i]));
+                else
+                    std::fputs(",", file);
+            }
+            if (ipc(m))
+                std::fprintf(file, ",%.4g\n", *ipc(m));
+            else
+                std::fputs(",\n", file);
+        }
+        return std::fclose(file) == 0;
+    }
+
+    bool writeJson(const std::string& path) const
+    {
+        std::FILE* file = std::fopen(path.c_str(), "w");
+        if (file == nullptr)
+            return false;
+        auto number = [&](const char* key, std::optional<double> value) {
+            if (value)
+                std::fprintf(file, ",\"%s\":%.6g", key, *value);
+            else
+                std::fprintf(file, ",\"%s\":null", key);
+        };
+        std::fputs("[\n", file);
+        for (size_t k = 0; k < m_measurements.size(); k++)
+        {
+            const auto& m = m_measurements[k];
+            std::fprintf(file, "{\"query\":\"%s\",\"implementation\":\"%s\",\"rows\":%zu,\"width\":%zu,\"selectivity\":%g,\"runs\":%zu",
+                m.name.c_str(), m.implementation.c_str(), m.rows, m.width, m.selectivity, m.runs);
+            number("ns_per_row", m.perRow(m.nanoseconds));
+            for (size_t i = 0; i < CounterCount; i++)
+            {
+                const std::string key = std::string(counterName(i)) + "_per_row";
+                number(key.c_str(), m.counters[i] ? std::optional<double>(m.perRow(*m.counters[i])) : std::nullopt);
+            }
+            number("ipc", ipc(m));
+            std::fputs(k + 1 == m_measurements.size() ? "}\n" : "},\n", file);
+        }
+        std::fputs("]\n", file);
+        return std::fclose(file) == 0;
+    }
+
+private:
+    std::vector<Measurement> m_measurements;
+};
+};
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace bench
+{
+enum Counter
+{
+    Cycles,
+    Instructions,
+    LlcMisses,
+    BranchMisses,
+    CounterCount
+};
+
+inline const char* counterName(size_t counter)
+{
+    static const char* names[CounterCount] = { "cycles", "instructions", "llc_misses", "branch_misses" };
+    return names[counter];
+}
+
+// Counts of one measured run; a counter the machine or kernel does not
+// provide is empty.
+struct CounterValues
+{
+    std::array<std::optional<double>, CounterCount> values;
+
+    std::optional<double> operator[](size_t counter) const
+    {
+        return values[counter];
+    }
+};
+
+// Hardware counters of the calling thread, read through perf_event_open.
+// Every counter is opened on its own so that one the PMU lacks, as in most
+// virtual machines, does not take the others with it. Without any, start()
+// and stop() do nothing and reason() says why.
+class PerfCounters
+{
+public:
+    PerfCounters()
+    {
+        m_fds.fill(-1);
+#ifdef __linux__
+        const std::array<uint64_t, CounterCount> configs = {
+            PERF_COUNT_HW_CPU_CYCLES,
+            PERF_COUNT_HW_INSTRUCTIONS,
+            PERF_COUNT_HW_CACHE_MISSES,
+            PERF_COUNT_HW_BRANCH_MISSES,
+        };
+        for (size_t i = 0; i < CounterCount; i++)
+        {
+            perf_event_attr attr;
+            std::memset(&attr, 0, sizeof(attr));
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = configs[i];
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            m_fds[i] = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+            if (m_fds[i] < 0 && m_reason.empty())
+                m_reason = std::string("perf_event_open: ") + std::strerror(errno);
+        }
+#else
+        m_reason = "hardware counters need Linux perf_event_open";
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    ~PerfCounters()
+    {
+#ifdef __linux__
+        for (int fd : m_fds)
+        {
+            if (fd >= 0)
+                close(fd);
+        }
+#endif
+    }
+
+    bool available() const
+    {
+        for (int fd : m_fds)
+        {
+            if (fd >= 0)
+                return true;
+        }
+        return false;
+    }
+
+    const std::string& reason() const
+    {
+        return m_reason;
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        for (int fd : m_fds)
+        {
+            if (fd >= 0)
+            {
+                ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+#endif
+    }
+
+    // Counts since start(), scaled up when the kernel multiplexed a counter
+    // with others and it ran only part of the time.
+    CounterValues stop()
+    {
+        CounterValues result;
+#ifdef __linux__
+        for (int fd : m_fds)
+        {
+            if (fd >= 0)
+                ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+        for (size_t i = 0; i < CounterCount; i++)
+        {
+            uint64_t data[3];
+            if (m_fds[i] < 0 || read(m_fds[i], data, sizeof(data)) != ssize_t(sizeof(data)) || data[2] == 0)
+                continue;
+            result.values[i] = double(data[0]) * double(data[1]) / double(data[2]);
+        }
+#endif
+        return result;
+    }
+
+private:
+    std::array<int, CounterCount> m_fds;
+    std::string m_reason;
+};
+};
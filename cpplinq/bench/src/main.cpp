@@ -0,0 +1,140 @@
+#include "suites.h"
+
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+void usage()
+{
+    std::printf(
+        "usage: cpplinq-bench [options]\n"
+        "  --suite operators        benchmarks to run: operators, tpch, overhead or all\n"
+        "  --scale F                TPC-H scale factor (default 0.1)\n"
+        "  --max-overhead P         fail the overhead suite above P percent (default 10)\n"
+        "  --max-rows N             largest input size, sizes are powers of ten from 1e3 (default 1e7)\n"
+        "  --widths 8,32,128        element widths in bytes\n"
+        "  --selectivities 0.01,0.5 fractions of rows a where keeps\n"
+        "  --max-bytes N            skip inputs larger than N bytes (default 1 GiB)\n"
+        "  --min-time MS            time every measurement for at least MS ms (default 50)\n"
+        "  --csv PATH               also write the results as CSV\n"
+        "  --json PATH              also write the results as JSON\n");
+}
+
+template <typename T>
+std::vector<T> parseList(const char* text)
+{
+    std::vector<T> values;
+    while (*text != '\0')
+    {
+        char* end = nullptr;
+        values.push_back(T(std::strtod(text, &end)));
+        if (end == text)
+            break;
+        text = *end == ',' ? end + 1 : end;
+    }
+    return values;
+}
+};
+
+int main(int argc, char* argv[])
+{
+    bench::Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (value == nullptr || std::strncmp(arg, "--", 2) != 0)
+        {
+            usage();
+            return std::strcmp(arg, "--help") == 0 ? 0 : 1;
+        }
+        i++;
+
+        if (std::strcmp(arg, "--suite") == 0)
+        {
+            options.suite = value;
+        }
+        else if (std::strcmp(arg, "--scale") == 0)
+        {
+            options.scale = std::strtod(value, nullptr);
+        }
+        else if (std::strcmp(arg, "--max-overhead") == 0)
+        {
+            options.maxOverhead = std::strtod(value, nullptr);
+        }
+        else if (std::strcmp(arg, "--max-rows") == 0)
+        {
+            const size_t maxRows = size_t(std::strtod(value, nullptr));
+            options.sizes.clear();
+            for (size_t size = 1000; size <= maxRows; size *= 10)
+            {
+                options.sizes.push_back(size);
+            }
+        }
+        else if (std::strcmp(arg, "--widths") == 0)
+        {
+            options.widths = parseList<size_t>(value);
+        }
+        else if (std::strcmp(arg, "--selectivities") == 0)
+        {
+            options.selectivities = parseList<double>(value);
+        }
+        else if (std::strcmp(arg, "--max-bytes") == 0)
+        {
+            options.maxBytes = size_t(std::strtod(value, nullptr));
+        }
+        else if (std::strcmp(arg, "--min-time") == 0)
+        {
+            options.minNanoseconds = std::strtod(value, nullptr) * 1e6;
+        }
+        else if (std::strcmp(arg, "--csv") == 0)
+        {
+            options.csv = value;
+        }
+        else if (std::strcmp(arg, "--json") == 0)
+        {
+            options.json = value;
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+
+    bench::PerfCounters counters;
+    bench::Report report;
+    bench::printHeader(counters);
+
+    bool ok = true;
+    if (options.suite == "operators" || options.suite == "all")
+    {
+        bench::runOperators(options, counters, report);
+    }
+    if (options.suite == "tpch" || options.suite == "all")
+    {
+        ok &= bench::runTpch(options, counters, report);
+    }
+    if (options.suite == "overhead" || options.suite == "all")
+    {
+        ok &= bench::runOverhead(options, counters, report);
+    }
+    if (options.suite != "operators" && options.suite != "tpch" && options.suite != "overhead" && options.suite != "all")
+    {
+        usage();
+        return 1;
+    }
+
+    if (!options.csv.empty() && !report.writeCsv(options.csv))
+    {
+        std::fprintf(stderr, "cpplinq-bench: cannot write %s\n", options.csv.c_str());
+        return 1;
+    }
+    if (!options.json.empty() && !report.writeJson(options.json))
+    {
+        std::fprintf(stderr, "cpplinq-bench: cannot write %s\n", options.json.c_str());
+        return 1;
+    }
+    return ok ? 0 : 1;
+}
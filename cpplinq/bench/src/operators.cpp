@@ -0,0 +1,282 @@
+#define USE_CPPLINQ_MACRO
+#include "cpplinq.h"
+#include "suites.h"
+
+#include <array>
+#include <unordered_map>
+
+#if defined(__cpp_lib_ranges)
+#include <ranges>
+#endif
+
+namespace
+{
+template <size_t Width>
+struct Row
+{
+    int key;
+    int value;
+    std::array<char, Width - 2 * sizeof(int)> pad;
+};
+
+struct Dimension
+{
+    int id;
+    int value;
+};
+
+struct Sweep
+{
+    bench::PerfCounters& counters;
+    bench::Report& report;
+    double minNanoseconds;
+    size_t rows;
+    size_t width;
+
+    template <typename Prepare, typename Query>
+    void run(const char* name, const char* implementation, double selectivity, Prepare prepare, Query query)
+    {
+        bench::Measurement m = bench::measure(counters, name, rows, prepare, query, minNanoseconds);
+        m.implementation = implementation;
+        m.width = width;
+        m.selectivity = selectivity;
+        report.add(m);
+    }
+
+    template <typename Query>
+    void run(const char* name, const char* implementation, double selectivity, Query query)
+    {
+        run(name, implementation, selectivity, []() {}, query);
+    }
+};
+
+uint32_t nextRandom(uint32_t& seed)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return seed >> 8;
+}
+
+// Keys are uniform in [0, 100), so key < 100 * s keeps a fraction s of rows.
+template <size_t Width>
+std::vector<Row<Width>> makeRows(size_t count)
+{
+    uint32_t seed = 12345;
+    std::vector<Row<Width>> rows(count);
+    for (auto& row : rows)
+    {
+        row.key = int(nextRandom(seed) % 100);
+        row.value = int(nextRandom(seed) % 1000000);
+    }
+    return rows;
+}
+
+template <size_t Width>
+void runWidth(const bench::Options& options, bench::PerfCounters& counters, bench::Report& report)
+{
+    using R = Row<Width>;
+
+    std::vector<Dimension> dimension(1024);
+    std::vector<Dimension> small(16);
+    for (int i = 0; i < 1024; i++)
+    {
+        dimension[i] = { i, i * 7 };
+    }
+    for (int i = 0; i < 16; i++)
+    {
+        small[i] = { i, i * 7 };
+    }
+
+    for (size_t size : options.sizes)
+    {
+        if (size * Width > options.maxBytes)
+        {
+            std::printf("# skipping %zu rows of %zu bytes, over --max-bytes\n", size, Width);
+            continue;
+        }
+
+        std::vector<R> rows = makeRows<Width>(size);
+        Sweep sweep = { counters, report, options.minNanoseconds, size, Width };
+
+        sweep.run("count", "cpplinq", 1, [&]() { return FROM (rows) COUNT (); });
+        sweep.run("count", "loop", 1, [&]() {
+            size_t count = 0;
+            for (auto it = rows.begin(); it != rows.end(); ++it)
+            {
+                count++;
+            }
+            return count;
+        });
+#if defined(__cpp_lib_ranges)
+        sweep.run("count", "ranges", 1, [&]() { return std::ranges::distance(rows); });
+#endif
+
+        for (double selectivity : options.selectivities)
+        {
+            const int threshold = int(selectivity * 100);
+            auto pass = [threshold](const R& o) { return o.key < threshold; };
+
+            sweep.run("where count", "cpplinq", selectivity, [&]() { return FROM (rows) .where(pass) COUNT (); });
+            sweep.run("where count", "loop", selectivity, [&]() {
+                size_t count = 0;
+                for (const auto& o : rows)
+                {
+                    if (o.key < threshold)
+                        count++;
+                }
+                return count;
+            });
+#if defined(__cpp_lib_ranges)
+            sweep.run("where count", "ranges", selectivity, [&]() {
+                return std::ranges::distance(rows | std::views::filter(pass));
+            });
+#endif
+
+            sweep.run("select", "cpplinq", selectivity, [&]() { return FROM (rows) .where(pass) SELECT (o.value, o.key); });
+            sweep.run("select", "loop", selectivity, [&]() {
+                std::vector<std::tuple<int, int>> result;
+                for (const auto& o : rows)
+                {
+                    if (o.key < threshold)
+                        result.push_back(std::make_tuple(o.value, o.key));
+                }
+                return result;
+            });
+#if defined(__cpp_lib_ranges)
+            sweep.run("select", "ranges", selectivity, [&]() {
+                std::vector<std::tuple<int, int>> result;
+                for (auto t : rows | std::views::filter(pass) | std::views::transform([](const R& o) { return std::make_tuple(o.value, o.key); }))
+                {
+                    result.push_back(t);
+                }
+                return result;
+            });
+#endif
+        }
+
+        std::vector<R> sorted;
+        auto copy = [&]() { sorted = rows; };
+        sweep.run("orderBy", "cpplinq", 1, copy, [&]() { return (FROM (sorted) ORDERBY (o.value)).first().value; });
+        sweep.run("orderBy", "loop", 1, copy, [&]() {
+            std::sort(sorted.begin(), sorted.end(), [](const R& l, const R& r) { return l.value < r.value; });
+            return sorted.front().value;
+        });
+#if defined(__cpp_lib_ranges)
+        sweep.run("orderBy", "ranges", 1, copy, [&]() {
+            std::ranges::sort(sorted, {}, &R::value);
+            return sorted.front().value;
+        });
+#endif
+
+        sweep.run("hashJoin", "cpplinq", 1, [&]() { return FROM (rows) HASHJOIN (dimension, o1.value & 1023, o2.id) COUNT (); });
+        sweep.run("hashJoin", "loop", 1, [&]() {
+            std::unordered_map<int, size_t> table;
+            for (const auto& d : dimension)
+            {
+                table[d.id]++;
+            }
+            size_t count = 0;
+            for (const auto& o : rows)
+            {
+                auto found = table.find(o.value & 1023);
+                if (found != table.end())
+                    count += found->second;
+            }
+            return count;
+        });
+
+        // The nested-loop join does rows * 16 comparisons; larger inputs
+        // only repeat what the smaller ones show.
+        if (size <= 1000000)
+        {
+            sweep.run("join", "cpplinq", 1, [&]() { return FROM (rows) JOIN (small) ON (o1.key == o2.id) COUNT (); });
+            sweep.run("join", "loop", 1, [&]() {
+                size_t count = 0;
+                for (const auto& o1 : rows)
+                {
+                    for (const auto& o2 : small)
+                    {
+                        if (o1.key == o2.id)
+                            count++;
+                    }
+                }
+                return count;
+            });
+        }
+    }
+}
+
+void runSum(const bench::Options& options, bench::PerfCounters& counters, bench::Report& report)
+{
+    for (size_t size : options.sizes)
+    {
+        if (size * sizeof(int64_t) > options.maxBytes)
+            continue;
+
+        uint32_t seed = 12345;
+        std::vector<int64_t> values(size);
+        for (auto& value : values)
+        {
+            value = int64_t(nextRandom(seed) % 100);
+        }
+        Sweep sweep = { counters, report, options.minNanoseconds, size, sizeof(int64_t) };
+
+        sweep.run("sum", "cpplinq", 1, [&]() { return FROM (values) SUM (); });
+        sweep.run("sum", "loop", 1, [&]() {
+            int64_t sum = 0;
+            for (int64_t value : values)
+            {
+                sum += value;
+            }
+            return sum;
+        });
+
+        for (double selectivity : options.selectivities)
+        {
+            const int threshold = int(selectivity * 100);
+            auto pass = [threshold](int64_t o) { return o < threshold; };
+
+            sweep.run("where sum", "cpplinq", selectivity, [&]() { return FROM (values) .where(pass) SUM (); });
+            sweep.run("where sum", "loop", selectivity, [&]() {
+                int64_t sum = 0;
+                for (int64_t value : values)
+                {
+                    if (value < threshold)
+                        sum += value;
+                }
+                return sum;
+            });
+#if defined(__cpp_lib_ranges)
+            sweep.run("where sum", "ranges", selectivity, [&]() {
+                int64_t sum = 0;
+                for (int64_t value : values | std::views::filter(pass))
+                {
+                    sum += value;
+                }
+                return sum;
+            });
+#endif
+        }
+    }
+}
+};
+
+namespace bench
+{
+void runOperators(const Options& options, PerfCounters& counters, Report& report)
+{
+    runSum(options, counters, report);
+    for (size_t width : options.widths)
+    {
+        switch (width)
+        {
+        case 8: runWidth<8>(options, counters, report); break;
+        case 16: runWidth<16>(options, counters, report); break;
+        case 32: runWidth<32>(options, counters, report); break;
+        case 64: runWidth<64>(options, counters, report); break;
+        case 128: runWidth<128>(options, counters, report); break;
+        case 256: runWidth<256>(options, counters, report); break;
+        default: std::printf("# skipping width %zu, supported widths are 8, 16, 32, 64, 128 and 256\n", width); break;
+        }
+    }
+}
+};
@@ -0,0 +1,196 @@
+#define USE_CPPLINQ_MACRO
+#include "cpplinq.h"
+#include "suites.h"
+
+#include <iterator>
+#include <type_traits>
+
+namespace
+{
+template <typename Query>
+struct Pipeline
+{
+    using Source = void;
+    using Condition = void;
+    using Iterator = void;
+};
+
+template <typename IterType, typename WhereCondition>
+struct Pipeline<zen::CppLinq<IterType, WhereCondition>>
+{
+    using Source = IterType;
+    using Condition = WhereCondition;
+    using Iterator = decltype(std::declval<zen::CppLinq<IterType, WhereCondition>&>().begin());
+};
+
+template <typename Iterator, typename = void>
+struct IsRandomAccess : std::false_type {};
+
+template <typename Iterator>
+struct IsRandomAccess<Iterator, std::void_t<typename std::iterator_traits<Iterator>::iterator_category>>
+    : std::is_base_of<std::random_access_iterator_tag, typename std::iterator_traits<Iterator>::iterator_category> {};
+
+// What the types of a source stage say about what keeps its loop from
+// compiling to the hand-written one.
+template <typename Query>
+std::vector<std::string> blockers(const Query&)
+{
+    using P = Pipeline<Query>;
+    std::vector<std::string> notes;
+    if constexpr (!std::is_void<typename P::Condition>::value)
+    {
+        using Row = zen::ElementType<typename P::Source>;
+        const bool filtered = !std::is_same<typename P::Condition, zen::DefaultCondition<Row>>::value;
+        if (std::is_pointer<typename P::Condition>::value)
+            notes.push_back("the condition is a function pointer, so every row is an indirect call unless the "
+                "compiler proves its target");
+        if (!IsRandomAccess<typename P::Source>::value)
+            notes.push_back("the source is not random-access, so the scan steps zen::iterator, which re-tests "
+                "m_iter != m_end && !m_condition(*m_iter) on every row");
+        else if (filtered)
+            notes.push_back("select(), skip() and take() over a filtered range fill a selection vector in "
+                "detail::forEachBatch before the consumer sees a row; count(), sum() and average() fuse the "
+                "condition into their loop");
+    }
+    if (notes.empty())
+        notes.push_back("nothing in the query's types; run codegen_check.py to compare the generated code");
+    return notes;
+}
+
+struct Overhead
+{
+    const bench::Options& options;
+    bench::PerfCounters& counters;
+    bench::Report& report;
+    size_t rows;
+    size_t width;
+    bool ok = true;
+
+    // Alternates the two versions a few times and compares the best time of
+    // each, which is steadier than the mean on a busy machine.
+    template <typename Query, typename Library, typename Hand>
+    void check(const char* name, const Query& query, Library library, Hand hand)
+    {
+        const int rounds = 25;
+        bench::Measurement best[2];
+        for (int round = 0; round < rounds; round++)
+        {
+            bench::Measurement m[2] = {
+                bench::measure(counters, name, rows, []() {}, library, options.minNanoseconds / rounds),
+                bench::measure(counters, name, rows, []() {}, hand, options.minNanoseconds / rounds),
+            };
+            for (int i = 0; i < 2; i++)
+            {
+                if (round == 0 || m[i].nanoseconds < best[i].nanoseconds)
+                    best[i] = m[i];
+            }
+        }
+        best[0].implementation = "cpplinq";
+        best[1].implementation = "loop";
+        best[0].width = best[1].width = width;
+        report.add(best[0]);
+        report.add(best[1]);
+
+        const double overhead = (best[0].nanoseconds / best[1].nanoseconds - 1) * 100;
+        const bool passed = overhead <= options.maxOverhead;
+        std::printf("# %s: %+.1f%% against the hand-written loop, %s\n", name, overhead, passed ? "ok" : "FAILED");
+        if (!passed)
+        {
+            for (const auto& note : blockers(query))
+            {
+                std::printf("#   %s\n", note.c_str());
+            }
+        }
+        ok &= passed;
+    }
+};
+};
+
+namespace bench
+{
+bool runOverhead(const Options& options, PerfCounters& counters, Report& report)
+{
+    const size_t rows = 1000000;
+    uint32_t seed = 12345;
+    std::vector<int> values(rows);
+    for (auto& value : values)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        value = int((seed >> 8) % 1000);
+    }
+
+    Overhead overhead = { options, counters, report, rows, sizeof(int) };
+
+    overhead.check("sum", FROM (values),
+        [&]() { return FROM (values) SUM (); },
+        [&]() {
+            int sum = 0;
+            for (int o : values)
+            {
+                sum += o;
+            }
+            return sum;
+        });
+
+    overhead.check("where sum", FROM (values) WHERE (o % 3 == 0),
+        [&]() { return FROM (values) WHERE (o % 3 == 0) SUM (); },
+        [&]() {
+            int sum = 0;
+            for (int o : values)
+            {
+                if (o % 3 == 0)
+                    sum += o;
+            }
+            return sum;
+        });
+
+    overhead.check("count", FROM (values),
+        [&]() { return FROM (values) COUNT (); },
+        [&]() {
+            size_t count = 0;
+            for (auto it = values.begin(); it != values.end(); ++it)
+            {
+                count++;
+            }
+            return count;
+        });
+
+    overhead.check("where count", FROM (values) WHERE (o % 3 == 0),
+        [&]() { return FROM (values) WHERE (o % 3 == 0) COUNT (); },
+        [&]() {
+            size_t count = 0;
+            for (int o : values)
+            {
+                if (o % 3 == 0)
+                    count++;
+            }
+            return count;
+        });
+
+    overhead.check("select", FROM (values),
+        [&]() { return FROM (values) SELECT (o * 2); },
+        [&]() {
+            std::vector<std::tuple<int>> result;
+            result.reserve(values.size());
+            for (int o : values)
+            {
+                result.push_back(std::make_tuple(o * 2));
+            }
+            return result;
+        });
+
+    overhead.check("where select", FROM (values) WHERE (o % 3 == 0),
+        [&]() { return FROM (values) WHERE (o % 3 == 0) SELECT (o * 2); },
+        [&]() {
+            std::vector<std::tuple<int>> result;
+            for (int o : values)
+            {
+                if (o % 3 == 0)
+                    result.push_back(std::make_tuple(o * 2));
+            }
+            return result;
+        });
+
+    return overhead.ok;
+}
+};
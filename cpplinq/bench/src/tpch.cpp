@@ -0,0 +1,261 @@
+#define USE_CPPLINQ_MACRO
+#include "cpplinq.h"
+#include "suites.h"
+#include "tpch.h"
+
+#include <cmath>
+
+using namespace tpch;
+
+namespace
+{
+constexpr int q1Cutoff = date(1998, 12, 1) - 90;
+constexpr int q3Date = date(1995, 3, 15);
+constexpr int q6From = date(1994, 1, 1);
+constexpr int q6To = date(1995, 1, 1);
+
+struct Q1Group
+{
+    double sumQty = 0;
+    double sumBasePrice = 0;
+    double sumDiscPrice = 0;
+    double sumCharge = 0;
+    double sumDisc = 0;
+    size_t count = 0;
+
+    void add(const LineItem& o)
+    {
+        sumQty += o.quantity;
+        sumBasePrice += o.extendedprice;
+        sumDiscPrice += o.extendedprice * (1 - o.discount);
+        sumCharge += o.extendedprice * (1 - o.discount) * (1 + o.tax);
+        sumDisc += o.discount;
+        count++;
+    }
+};
+
+struct Q1Row
+{
+    char returnflag;
+    char linestatus;
+    double sumQty;
+    double sumBasePrice;
+    double sumDiscPrice;
+    double sumCharge;
+    double avgQty;
+    double avgPrice;
+    double avgDisc;
+    size_t count;
+};
+
+Q1Row q1Row(int key, const Q1Group& g)
+{
+    return { char(key / 256), char(key % 256), g.sumQty, g.sumBasePrice, g.sumDiscPrice, g.sumCharge,
+        g.sumQty / double(g.count), g.sumBasePrice / double(g.count), g.sumDisc / double(g.count), g.count };
+}
+
+struct Q3Group
+{
+    int orderdate = 0;
+    int shippriority = 0;
+    double revenue = 0;
+};
+
+struct Q3Row
+{
+    int orderkey;
+    double revenue;
+    int orderdate;
+    int shippriority;
+};
+
+// Pricing summary report: aggregates of shipped line items per return flag
+// and line status.
+std::vector<Q1Row> q1(const Database& db)
+{
+    auto groups = FROM (db.lineitems)
+        WHERE (o.shipdate <= q1Cutoff)
+        GROUPBY (o.returnflag * 256 + o.linestatus, Q1Group(), acc.add(o));
+
+    return FROM (groups)
+        ORDERBY (o.first)
+        .select([](const auto& o) { return q1Row(o.first, o.second); });
+}
+
+std::vector<Q1Row> q1Reference(const Database& db)
+{
+    std::vector<Q1Group> groups(256 * 256);
+    for (const auto& o : db.lineitems)
+    {
+        if (o.shipdate <= q1Cutoff)
+            groups[o.returnflag * 256 + o.linestatus].add(o);
+    }
+    std::vector<Q1Row> result;
+    for (int key = 0; key < 256 * 256; key++)
+    {
+        if (groups[key].count != 0)
+            result.push_back(q1Row(key, groups[key]));
+    }
+    return result;
+}
+
+// Shipping priority: the ten unshipped orders of the building segment with
+// the highest revenue.
+std::vector<Q3Row> q3(const Database& db)
+{
+    auto groups = FROM (db.customers)
+        WHERE (o.mktsegment == Building)
+        HASHJOIN (db.orders, o1.custkey, o2.custkey)
+        WHERERIGHT (o2.orderdate < q3Date)
+        HASHJOIN2 (db.lineitems, o2.orderkey, o3.orderkey)
+        WHERERIGHT2 (o3.shipdate > q3Date)
+        GROUPBY3 (o2.orderkey, Q3Group(),
+            acc.orderdate = o2.orderdate; acc.shippriority = o2.shippriority; acc.revenue += o3.extendedprice * (1 - o3.discount));
+
+    return FROM (groups)
+        ORDERBY (std::make_tuple(-o.second.revenue, o.second.orderdate))
+        TAKE (10)
+        .select([](const auto& o) { return Q3Row{ o.first, o.second.revenue, o.second.orderdate, o.second.shippriority }; });
+}
+
+std::vector<Q3Row> q3Reference(const Database& db)
+{
+    std::vector<char> building(db.customers.size() + 1, 0);
+    for (const auto& c : db.customers)
+    {
+        building[c.custkey] = c.mktsegment == Building;
+    }
+
+    int maxKey = 0;
+    for (const auto& o : db.orders)
+    {
+        maxKey = std::max(maxKey, o.orderkey);
+    }
+    std::vector<int> slot(size_t(maxKey) + 1, -1);
+    for (size_t i = 0; i < db.orders.size(); i++)
+    {
+        const auto& o = db.orders[i];
+        if (o.orderdate < q3Date && building[o.custkey])
+            slot[o.orderkey] = int(i);
+    }
+
+    std::vector<double> revenue(db.orders.size(), 0);
+    std::vector<char> matched(db.orders.size(), 0);
+    for (const auto& l : db.lineitems)
+    {
+        const int i = slot[l.orderkey];
+        if (i >= 0 && l.shipdate > q3Date)
+        {
+            revenue[i] += l.extendedprice * (1 - l.discount);
+            matched[i] = 1;
+        }
+    }
+
+    std::vector<Q3Row> result;
+    for (size_t i = 0; i < db.orders.size(); i++)
+    {
+        if (matched[i])
+            result.push_back({ db.orders[i].orderkey, revenue[i], db.orders[i].orderdate, db.orders[i].shippriority });
+    }
+    auto top = result.begin() + std::min<size_t>(10, result.size());
+    std::partial_sort(result.begin(), top, result.end(), [](const Q3Row& l, const Q3Row& r) {
+        return l.revenue != r.revenue ? l.revenue > r.revenue : l.orderdate < r.orderdate;
+    });
+    result.erase(top, result.end());
+    return result;
+}
+
+// Forecasting revenue change: revenue of discounted 1994 line items with
+// small quantities.
+double q6(const Database& db)
+{
+    auto revenues = FROM (db.lineitems)
+        WHERE (o.shipdate >= q6From && o.shipdate < q6To && o.discount >= 0.05 - 1e-9 && o.discount <= 0.07 + 1e-9 && o.quantity < 24)
+        .select([](const LineItem& o) { return o.extendedprice * o.discount; });
+
+    return FROM (revenues) SUM ();
+}
+
+double q6Reference(const Database& db)
+{
+    double revenue = 0;
+    for (const auto& o : db.lineitems)
+    {
+        if (o.shipdate >= q6From && o.shipdate < q6To && o.discount >= 0.05 - 1e-9 && o.discount <= 0.07 + 1e-9 && o.quantity < 24)
+            revenue += o.extendedprice * o.discount;
+    }
+    return revenue;
+}
+
+// Sums may add the same values in another order.
+bool close(double l, double r)
+{
+    return std::fabs(l - r) <= 1e-9 * std::max({ 1.0, std::fabs(l), std::fabs(r) });
+}
+
+bool same(const std::vector<Q1Row>& l, const std::vector<Q1Row>& r)
+{
+    if (l.size() != r.size())
+        return false;
+    for (size_t i = 0; i < l.size(); i++)
+    {
+        if (l[i].returnflag != r[i].returnflag || l[i].linestatus != r[i].linestatus || l[i].count != r[i].count ||
+            !close(l[i].sumQty, r[i].sumQty) || !close(l[i].sumBasePrice, r[i].sumBasePrice) ||
+            !close(l[i].sumDiscPrice, r[i].sumDiscPrice) || !close(l[i].sumCharge, r[i].sumCharge) ||
+            !close(l[i].avgQty, r[i].avgQty) || !close(l[i].avgPrice, r[i].avgPrice) || !close(l[i].avgDisc, r[i].avgDisc))
+            return false;
+    }
+    return true;
+}
+
+bool same(const std::vector<Q3Row>& l, const std::vector<Q3Row>& r)
+{
+    if (l.size() != r.size())
+        return false;
+    for (size_t i = 0; i < l.size(); i++)
+    {
+        if (l[i].orderkey != r[i].orderkey || l[i].orderdate != r[i].orderdate || l[i].shippriority != r[i].shippriority ||
+            !close(l[i].revenue, r[i].revenue))
+            return false;
+    }
+    return true;
+}
+
+bool same(double l, double r)
+{
+    return close(l, r);
+}
+
+template <typename Query, typename Reference>
+bool run(const char* name, const Database& db, bench::PerfCounters& counters, bench::Report& report,
+    double minNanoseconds, Query query, Reference reference)
+{
+    const bool ok = same(query(db), reference(db));
+    std::printf("# %s: %s\n", name, ok ? "matches the reference" : "DIFFERS from the reference");
+
+    auto add = [&](bench::Measurement m, const char* implementation) {
+        m.implementation = implementation;
+        m.width = sizeof(LineItem);
+        report.add(m);
+    };
+    add(bench::measure(counters, name, db.lineitems.size(), []() {}, [&]() { return query(db); }, minNanoseconds), "cpplinq");
+    add(bench::measure(counters, name, db.lineitems.size(), []() {}, [&]() { return reference(db); }, minNanoseconds), "loop");
+    return ok;
+}
+};
+
+namespace bench
+{
+bool runTpch(const Options& options, PerfCounters& counters, Report& report)
+{
+    const Database db = generate(options.scale);
+    std::printf("# tpch scale %g: %zu customers, %zu orders, %zu line items\n", options.scale, db.customers.size(),
+        db.orders.size(), db.lineitems.size());
+
+    bool ok = true;
+    ok &= run("tpch q1", db, counters, report, options.minNanoseconds, q1, q1Reference);
+    ok &= run("tpch q3", db, counters, report, options.minNanoseconds, q3, q3Reference);
+    ok &= run("tpch q6", db, counters, report, options.minNanoseconds, q6, q6Reference);
+    return ok;
+}
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "harness.h"
+
+namespace bench
+{
+struct Options
+{
+    std::vector<size_t> sizes = { 1000, 10000, 100000, 1000000, 10000000 };
+    std::vector<size_t> widths = { 8, 32, 128 };
+    std::vector<double> selectivities = { 0.01, 0.1, 0.5, 0.9 };
+    size_t maxBytes = size_t(1) << 30;
+    double minNanoseconds = 5e7;
+    double scale = 0.1;
+    double maxOverhead = 10;
+    std::string suite = "operators";
+    std::string csv;
+    std::string json;
+};
+
+// Sweeps where, count, select, sum, orderBy and joins over input size,
+// element width and selectivity, each against a hand-written loop and,
+// where the standard library has one, a std::ranges pipeline.
+void runOperators(const Options& options, PerfCounters& counters, Report& report);
+
+// Generates TPC-H-like tables at options.scale and times ports of queries 1,
+// 3 and 6 against hand-coded references; false if any result differs.
+bool runTpch(const Options& options, PerfCounters& counters, Report& report);
+
+// Compares macro pipelines with the loops they should compile to; false if
+// one is more than options.maxOverhead percent slower, after printing what
+// in its types keeps it from inlining.
+bool runOverhead(const Options& options, PerfCounters& counters, Report& report);
+};
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// A deterministic generator for tables shaped like the TPC-H customer, orders
+// and lineitem tables, with the columns queries 1, 3 and 6 read. Value
+// distributions follow the specification closely enough for the queries to
+// keep their selectivities; this is not a conforming dbgen.
+namespace tpch
+{
+// Days since 1992-01-01.
+constexpr int date(int year, int month, int day)
+{
+    const int y = month <= 2 ? year - 1 : year;
+    const int era = y / 400;
+    const int yoe = y - era * 400;
+    const int doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    const int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 727503;
+}
+
+constexpr int startDate = date(1992, 1, 1);
+constexpr int endDate = date(1998, 12, 31);
+constexpr int currentDate = date(1995, 6, 17);
+
+enum Segment
+{
+    Automobile,
+    Building,
+    Furniture,
+    Household,
+    Machinery,
+    SegmentCount
+};
+
+struct Customer
+{
+    int custkey;
+    int nationkey;
+    int mktsegment;
+};
+
+struct Order
+{
+    int orderkey;
+    int custkey;
+    int orderdate;
+    int shippriority;
+    double totalprice;
+};
+
+struct LineItem
+{
+    int orderkey;
+    int shipdate;
+    double quantity;
+    double extendedprice;
+    double discount;
+    double tax;
+    char returnflag;
+    char linestatus;
+};
+
+struct Database
+{
+    std::vector<Customer> customers;
+    std::vector<Order> orders;
+    std::vector<LineItem> lineitems;
+};
+
+class Random
+{
+public:
+    explicit Random(uint64_t seed) : m_state(seed) {}
+
+    // Uniform in [low, high].
+    int between(int low, int high)
+    {
+        m_state = m_state * 6364136223846793005ull + 1442695040888963407ull;
+        return low + int((m_state >> 33) % uint64_t(high - low + 1));
+    }
+
+private:
+    uint64_t m_state;
+};
+
+// Scale factor 1 has 150,000 customers, 1,500,000 orders and about
+// 6,000,000 line items; the same scale always yields the same tables.
+inline Database generate(double scale)
+{
+    Database db;
+    const int customers = std::max(1, int(150000 * scale));
+    const int orders = customers * 10;
+    Random random(20240601);
+
+    db.customers.reserve(customers);
+    for (int i = 0; i < customers; i++)
+    {
+        db.customers.push_back({ i + 1, random.between(0, 24), random.between(0, SegmentCount - 1) });
+    }
+
+    db.orders.reserve(orders);
+    db.lineitems.reserve(size_t(orders) * 4);
+    for (int i = 0; i < orders; i++)
+    {
+        Order order;
+        // Keys are sparse as in dbgen, 8 used out of every 32.
+        order.orderkey = (i / 8) * 32 + i % 8 + 1;
+        // Only two of every three customers place orders.
+        do
+        {
+            order.custkey = random.between(1, customers);
+        } while (customers > 2 && order.custkey % 3 == 0);
+        order.orderdate = random.between(startDate, endDate - 151);
+        order.shippriority = 0;
+        order.totalprice = 0;
+
+        const int lines = random.between(1, 7);
+        for (int line = 0; line < lines; line++)
+        {
+            LineItem item;
+            item.orderkey = order.orderkey;
+            item.quantity = random.between(1, 50);
+            const double price = (90000 + random.between(0, 110000)) / 100.0;
+            item.extendedprice = item.quantity * price;
+            item.discount = random.between(0, 10) / 100.0;
+            item.tax = random.between(0, 8) / 100.0;
+            item.shipdate = order.orderdate + random.between(1, 121);
+            const int receiptdate = item.shipdate + random.between(1, 30);
+            item.returnflag = receiptdate <= currentDate ? (random.between(0, 1) ? 'R' : 'A') : 'N';
+            item.linestatus = item.shipdate > currentDate ? 'O' : 'F';
+            order.totalprice += item.extendedprice * (1 + item.tax) * (1 - item.discount);
+            db.lineitems.push_back(item);
+        }
+        db.orders.push_back(order);
+    }
+    return db;
+}
+};
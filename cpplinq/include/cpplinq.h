@@ -1,22 +1,179 @@
 #include <tuple>
 #include <vector>
 #include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <unordered_map>
+#include <type_traits>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <memory>
+#include <chrono>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <array>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L && __has_include(<coroutine>)
+#include <coroutine>
+#define CPPLINQ_HAS_COROUTINES
+#endif
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace zen
 {
 template <typename IterType>
 using ElementType = typename std::decay<decltype(*std::declval<IterType>())>::type;
 
+namespace detail
+{
+#ifdef CPPLINQ_PROFILE
+// Heap use of the query being analyzed. Workers of a parallel operator count
+// into the same instance; peak is the highest live byte count since the
+// running operator started.
+struct AllocationCounter
+{
+    std::atomic<size_t> allocations{ 0 };
+    std::atomic<size_t> bytes{ 0 };
+    std::atomic<int64_t> live{ 0 };
+    std::atomic<int64_t> peak{ 0 };
+
+    void allocate(size_t size)
+    {
+        allocations++;
+        bytes += size;
+        const int64_t now = live += int64_t(size);
+        int64_t highest = peak.load(std::memory_order_relaxed);
+        while (now > highest && !peak.compare_exchange_weak(highest, now))
+        {
+        }
+    }
+
+    void deallocate(size_t size)
+    {
+        live -= int64_t(size);
+    }
+};
+
+inline AllocationCounter*& currentAllocations()
+{
+    thread_local AllocationCounter* counter = nullptr;
+    return counter;
+}
+
+// Counts into the query being analyzed on this thread, if any, and is a
+// plain std::allocator otherwise.
+template <typename T>
+struct CountingAllocator
+{
+    using value_type = T;
+
+    CountingAllocator() = default;
+
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>&) {}
+
+    T* allocate(size_t n)
+    {
+        T* p = std::allocator<T>().allocate(n);
+        if (currentAllocations() != nullptr)
+            currentAllocations()->allocate(n * sizeof(T));
+        return p;
+    }
+
+    void deallocate(T* p, size_t n)
+    {
+        if (currentAllocations() != nullptr)
+            currentAllocations()->deallocate(n * sizeof(T));
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator==(const CountingAllocator<U>&) const { return true; }
+
+    template <typename U>
+    bool operator!=(const CountingAllocator<U>&) const { return false; }
+};
+
+template <typename T>
+using Allocator = CountingAllocator<T>;
+#else
+template <typename T>
+using Allocator = std::allocator<T>;
+#endif
+
+// Containers the operators allocate for themselves, as opposed to the results
+// handed to the caller.
+template <typename T>
+using Vector = std::vector<T, Allocator<T>>;
+
+template <typename Key, typename Value>
+using HashMap = std::unordered_map<Key, Value, std::hash<Key>, std::equal_to<Key>, Allocator<std::pair<const Key, Value>>>;
+};
+
 template <typename EleType>
-using IteratorType = typename std::decay<decltype(std::vector<EleType>().begin())>::type;
+using IteratorType = typename detail::Vector<EleType>::iterator;
 
+// The condition of a query without where(). It is a type of its own rather
+// than a function pointer, so scans skip it at compile time and the query
+// iterates the source's own iterator.
 template <typename T>
-using DefaultCondition = bool(*)(const T&);
+struct DefaultCondition
+{
+    constexpr bool operator()(const T&) const { return true; }
+};
+
+#ifndef CPPLINQ_BLOCK_BYTES
+#define CPPLINQ_BLOCK_BYTES 16384
+#endif
+
+#ifndef CPPLINQ_BATCH_SIZE
+#define CPPLINQ_BATCH_SIZE 1024
+#endif
+
+#ifndef CPPLINQ_PARTITION_BYTES
+#define CPPLINQ_PARTITION_BYTES 262144
+#endif
+
+#ifndef CPPLINQ_CSV_CHUNK_BYTES
+#define CPPLINQ_CSV_CHUNK_BYTES 1048576
+#endif
 
+// Visits the elements of [begin, end) that satisfy the condition. It is
+// bidirectional over bidirectional sources, since a filter cannot be indexed.
 template <typename IterType, typename Condition>
 class iterator
 {
+    using SourceCategory = typename std::iterator_traits<IterType>::iterator_category;
+
 public:
+    using iterator_category = typename std::conditional<std::is_base_of<std::bidirectional_iterator_tag, SourceCategory>::value,
+        std::bidirectional_iterator_tag, SourceCategory>::type;
+    using value_type = ElementType<IterType>;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
     iterator(IterType begin, IterType end, IterType it, Condition cond) 
         : m_begin(begin), m_end(end), m_iter(it), m_condition(cond)
     {
@@ -35,63 +192,73 @@ public:
         return *this;
     }
 
-    iterator& operator++(int)
+    iterator operator++(int)
     {
         iterator it(*this);
+        ++*this;
+        return it;
+    }
+
+    // Steps back to the previous selected element, or to begin if there is none.
+    iterator& operator--()
+    {
         do
         {
-            m_iter++;
-        } while (m_iter != m_end && !m_condition(*m_iter));
+            m_iter--;
+        } while (m_iter != m_begin && !m_condition(*m_iter));
+        return *this;
+    }
+
+    iterator operator--(int)
+    {
+        iterator it(*this);
+        --*this;
         return it;
     }
 
-    iterator operator+(size_t steps)
+    iterator operator+(size_t steps) const
     {
         iterator it = *this;
-        while(steps--)
+        while (steps != 0 && it.m_iter != m_end)
         {
             ++it;
+            steps--;
         }
         return it;
     }
 
-    iterator operator-(size_t steps)
+    iterator operator-(size_t steps) const
     {
         iterator it = *this;
         while (steps != 0 && it.m_iter != m_begin)
         {
-            if (m_condition(*m_iter))
-            {
-                steps--;
-            }
-            it.m_iter--;
+            --it;
+            steps--;
         }
         return it;
     }
 
-    size_t operator-(const iterator& r)
+    size_t operator-(const iterator& r) const
     {
-        int count = 0;
-        iterator it = r;
-        while (it != *this)
+        size_t count = 0;
+        for (iterator it = r; it != *this; ++it)
         {
-            ++it;
             count++;
         }
         return count;
     }
 
-    bool operator==(const iterator& r)
+    bool operator==(const iterator& r) const
     {
         return m_iter == r.m_iter;
     }
 
-    bool operator!=(const iterator& r)
+    bool operator!=(const iterator& r) const
     {
         return m_iter != r.m_iter;
     }
 
-    const ElementType<IterType>& operator*()
+    const ElementType<IterType>& operator*() const
     {
         return *m_iter;
     }
@@ -103,470 +270,3305 @@ private:
     Condition m_condition;
 };
 
+template <typename IterType, typename Condition>
+struct QueryIterator
+{
+    using type = iterator<IterType, Condition>;
+};
+
+template <typename IterType, typename T>
+struct QueryIterator<IterType, DefaultCondition<T>>
+{
+    using type = IterType;
+};
+
 enum Order
 {
     Ascend = 0,
     Descend = 1
 };
 
-template <typename... Types>
-class CppLinq;
+// Expression templates for conditions, keys and projections, for example
+// col(&Record::x) > 5 && col<2>(&Record2::b) == 3. Every node is an ordinary
+// function object, so it inlines like a lambda, but its type records the
+// expression tree and the set of inputs it reads.
+struct ExpressionTag {};
 
-template <typename... Types>
-struct Data;
+template <typename T>
+using IsExpression = std::is_base_of<ExpressionTag, typename std::decay<T>::type>;
 
-template <typename IterType, typename RealType, typename WhereCondition = DefaultCondition<ElementType<IterType>>>
-class Base
+template <size_t Input, typename Class, typename T>
+struct Column : ExpressionTag
 {
-public:
-    Base(WhereCondition condition) : m_condition(condition) {}
+    static constexpr unsigned inputs = 1u << (Input - 1);
 
-    Base(IterType begin, IterType end) : m_condition([](const auto&){ return true; })
+    explicit Column(T Class::*member) : member(member) {}
+
+    template <typename... Rows>
+    const T& operator()(const Rows&... rows) const
     {
-        m_begin = begin;
-        m_end = end;
+        return std::get<Input - 1>(std::forward_as_tuple(rows...)).*member;
     }
 
-    Base(IterType begin, IterType end, WhereCondition condition) : m_condition(condition)
+    T Class::*member;
+};
+
+template <typename T>
+struct Constant : ExpressionTag
+{
+    static constexpr unsigned inputs = 0;
+
+    explicit Constant(const T& value) : value(value) {}
+
+    template <typename... Rows>
+    const T& operator()(const Rows&...) const
     {
-        m_begin = begin;
-        m_end = end;
+        return value;
     }
 
-    const auto& first()
+    T value;
+};
+
+template <typename Op, typename L, typename R>
+struct Binary : ExpressionTag
+{
+    static constexpr unsigned inputs = L::inputs | R::inputs;
+
+    Binary(const L& left, const R& right) : left(left), right(right) {}
+
+    template <typename... Rows>
+    auto operator()(const Rows&... rows) const
     {
-        return *begin();
+        return Op::apply(left, right, rows...);
     }
 
-    const auto& last()
+    L left;
+    R right;
+};
+
+template <typename E>
+struct Not : ExpressionTag
+{
+    static constexpr unsigned inputs = E::inputs;
+
+    explicit Not(const E& operand) : operand(operand) {}
+
+    template <typename... Rows>
+    bool operator()(const Rows&... rows) const
     {
-        return *(end() - 1);
+        return !operand(rows...);
     }
 
-    size_t count()
+    E operand;
+};
+
+template <size_t Input = 1, typename Class, typename T>
+Column<Input, Class, T> col(T Class::*member)
+{
+    return Column<Input, Class, T>(member);
+}
+
+namespace detail
+{
+template <typename T>
+auto lift(const T& value)
+{
+    if constexpr (IsExpression<T>::value)
+        return value;
+    else
+        return Constant<T>(value);
+}
+};
+
+template <typename E, typename = typename std::enable_if<IsExpression<E>::value>::type>
+Not<E> operator!(const E& operand)
+{
+    return Not<E>(operand);
+}
+
+#define CPPLINQ_EXPRESSION_OPERATOR(Name, token) \
+    namespace ops \
+    { \
+    struct Name \
+    { \
+        template <typename L, typename R, typename... Rows> \
+        static auto apply(const L& l, const R& r, const Rows&... rows) { return l(rows...) token r(rows...); } \
+    }; \
+    }; \
+    template <typename L, typename R, typename = typename std::enable_if<IsExpression<L>::value || IsExpression<R>::value>::type> \
+    auto operator token(const L& l, const R& r) \
+    { \
+        using Left = decltype(detail::lift(l)); \
+        using Right = decltype(detail::lift(r)); \
+        return Binary<ops::Name, Left, Right>(detail::lift(l), detail::lift(r)); \
+    }
+
+CPPLINQ_EXPRESSION_OPERATOR(Add, +)
+CPPLINQ_EXPRESSION_OPERATOR(Subtract, -)
+CPPLINQ_EXPRESSION_OPERATOR(Multiply, *)
+CPPLINQ_EXPRESSION_OPERATOR(Divide, /)
+CPPLINQ_EXPRESSION_OPERATOR(Modulo, %)
+CPPLINQ_EXPRESSION_OPERATOR(Equal, ==)
+CPPLINQ_EXPRESSION_OPERATOR(NotEqual, !=)
+CPPLINQ_EXPRESSION_OPERATOR(Less, <)
+CPPLINQ_EXPRESSION_OPERATOR(LessEqual, <=)
+CPPLINQ_EXPRESSION_OPERATOR(Greater, >)
+CPPLINQ_EXPRESSION_OPERATOR(GreaterEqual, >=)
+CPPLINQ_EXPRESSION_OPERATOR(And, &&)
+CPPLINQ_EXPRESSION_OPERATOR(Or, ||)
+
+#undef CPPLINQ_EXPRESSION_OPERATOR
+
+enum JoinHint
+{
+    NoHint = 0,
+    BloomFilter = 1,
+    RadixPartition = 2,
+    DirectAddress = 4
+};
+
+inline JoinHint operator|(JoinHint l, JoinHint r)
+{
+    return JoinHint((int)l | (int)r);
+}
+
+namespace detail
+{
+inline uint64_t mix(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+};
+
+// Bloom filter whose k probes all land in one 64-byte block, so a lookup
+// costs a single cache miss. It never reports a false negative.
+template <typename Key>
+class BlockedBloomFilter
+{
+public:
+    explicit BlockedBloomFilter(size_t expectedCount, size_t bitsPerKey = 10)
+        : m_blocks((expectedCount * bitsPerKey + 511) / 512 + 1)
     {
-        return end() - begin();
     }
 
-    auto sum()
+    void insert(const Key& key)
     {
-        ElementType<IterType> sum = 0;
-        for (const auto& element : *this)
+        uint64_t h = hash(key);
+        Block& block = m_blocks[(h >> 32) % m_blocks.size()];
+        for (int i = 0; i < 8; i++)
         {
-            sum += element;
+            block.words[i] |= bit(h, i);
         }
-        return sum;
     }
 
-    auto average()
+    bool mayContain(const Key& key) const
     {
-        ElementType<IterType> sum = 0;
-        int count = 0;
-        for (const auto& element : *this)
+        uint64_t h = hash(key);
+        const Block& block = m_blocks[(h >> 32) % m_blocks.size()];
+        uint64_t missing = 0;
+        for (int i = 0; i < 8; i++)
         {
-            sum += element;
-            count++;
+            missing |= bit(h, i) & ~block.words[i];
         }
-        return sum / (ElementType<IterType>)count;
+        return missing == 0;
     }
 
-    auto take(size_t count)
+    bool operator()(const Key& key) const
     {
-        m_takeCount = count;
-        return *(RealType*)this;
+        return mayContain(key);
     }
 
-    auto skip(size_t count)
+private:
+    struct alignas(64) Block
     {
-        m_skipCount = count;
-        return *(RealType*)this;
+        uint64_t words[8] = {};
+    };
+
+    static uint64_t hash(const Key& key)
+    {
+        return detail::mix(std::hash<Key>()(key));
+    }
+
+    static uint64_t bit(uint64_t h, int i)
+    {
+        static const uint32_t salts[8] = {
+            0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+            0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U };
+        return 1ULL << ((uint32_t(h) * salts[i]) >> 26);
     }
 
-    iterator<IterType, WhereCondition> begin()
+    detail::Vector<Block> m_blocks;
+};
+
+// Shared flag for abandoning queries started with runAsync().
+class CancellationToken
+{
+public:
+    CancellationToken() : m_cancelled(std::make_shared<std::atomic<bool>>(false)) {}
+
+    void cancel()
     {
-        return iterator<IterType, WhereCondition>(m_begin, m_end, m_begin, m_condition) + m_skipCount;
+        *m_cancelled = true;
     }
 
-    iterator<IterType, WhereCondition> end()
+    bool cancelled() const
     {
-        return iterator<IterType, WhereCondition>(m_begin, m_end, m_end, m_condition);
+        return *m_cancelled;
     }
 
-protected:
-    IterType m_begin;
-    IterType m_end;
-    WhereCondition m_condition;
-    size_t m_takeCount = SIZE_MAX;
-    size_t m_skipCount = 0;
+private:
+    std::shared_ptr<std::atomic<bool>> m_cancelled;
 };
 
-template <typename T1, typename T2, typename T3, typename T4>
-struct Data<T1, T2, T3, T4>
+class QueryCancelled : public std::runtime_error
 {
-    T1 var1;
-    T2 var2;
-    T3 var3;
-    T4 var4;
+public:
+    using std::runtime_error::runtime_error;
 };
 
-template <typename T1, typename T2, typename T3, typename T4, typename WhereCondition>
-class CppLinq<T1, T2, T3, T4, WhereCondition> : public Base<
-    IteratorType<Data<T1,T2,T3,T4>>,
-    CppLinq<T1, T2, T3, T4, WhereCondition>,
-    WhereCondition>
+namespace detail
+{
+struct StopCondition
+{
+    CancellationToken token;
+    std::chrono::steady_clock::time_point deadline;
+};
+
+inline const StopCondition*& currentStop()
+{
+    thread_local const StopCondition* stop = nullptr;
+    return stop;
+}
+
+// Called by scans between morsels; throws QueryCancelled once the query that
+// runs on this thread is cancelled or past its deadline.
+inline void checkpoint()
+{
+    const StopCondition* stop = currentStop();
+    if (stop == nullptr)
+        return;
+    if (stop->token.cancelled())
+        throw QueryCancelled("cpplinq: query cancelled");
+    if (std::chrono::steady_clock::now() >= stop->deadline)
+        throw QueryCancelled("cpplinq: query deadline exceeded");
+}
+
+class StopScope
 {
-    using super = Base<
-        IteratorType<Data<T1,T2,T3,T4>>,
-        CppLinq<T1, T2, T3, T4, WhereCondition>,
-        WhereCondition>;
-private:
-    std::vector<Data<T1, T2, T3, T4>> m_data;
 public:
-    CppLinq() : super([](const auto&){return true;})
+    explicit StopScope(const StopCondition* stop) : m_previous(currentStop())
     {
-        super::m_begin = m_data.begin();
-        super::m_end = m_data.end();
+        currentStop() = stop;
     }
 
-    CppLinq(std::vector<Data<T1, T2, T3, T4>>& v, WhereCondition condition) : super(condition)
+    StopScope(const StopScope&) = delete;
+    StopScope& operator=(const StopScope&) = delete;
+
+    ~StopScope()
     {
-        std::swap(m_data, v);
-        super::m_begin = m_data.begin();
-        super::m_end = m_data.end();
+        currentStop() = m_previous;
     }
 
-    void addData(const Data<T1, T2, T3, T4>& v)
+private:
+    const StopCondition* m_previous;
+};
+
+template <typename Query, typename Terminal>
+auto runAsync(Query&& query, Terminal terminal, CancellationToken token, std::chrono::steady_clock::time_point deadline)
+{
+    return std::async(std::launch::async, [query = std::move(query), terminal, token, deadline]() mutable {
+        StopCondition stop = { token, deadline };
+        StopScope scope(&stop);
+        return terminal(query);
+    });
+}
+};
+
+// Rows, time and heap use of one operator run, as recorded by analyze().
+// Allocations and bytes count what the operator and the operators it runs
+// allocated; peakBytes is the most it held at once.
+struct StageProfile
+{
+    std::string op;
+    std::string engine;
+    size_t rowsIn = 0;
+    size_t rowsOut = 0;
+    uint64_t nanoseconds = 0;
+    size_t allocations = 0;
+    size_t bytes = 0;
+    size_t peakBytes = 0;
+};
+
+struct QueryProfile
+{
+    std::vector<StageProfile> stages;
+    size_t allocations = 0;
+    size_t bytes = 0;
+    size_t peakBytes = 0;
+
+    std::string format() const
     {
-        m_data.push_back(v);
-        super::m_begin = m_data.begin();
-        super::m_end = m_data.end();
+        std::string text = "operator    engine                                rows in    rows out   time (us)    allocs       bytes        peak\n";
+        char line[200];
+        for (const auto& stage : stages)
+        {
+            std::snprintf(line, sizeof(line), "%-11s %-36s %9zu %11zu %11.1f %9zu %11zu %11zu\n", stage.op.c_str(), stage.engine.c_str(),
+                stage.rowsIn, stage.rowsOut, stage.nanoseconds / 1000.0, stage.allocations, stage.bytes, stage.peakBytes);
+            text += line;
+        }
+        std::snprintf(line, sizeof(line), "%-82s %9zu %11zu %11zu\n", "query", allocations, bytes, peakBytes);
+        text += line;
+        return text;
     }
+};
 
-    template <typename Condition2>
-    auto where(Condition2 condition)
+namespace detail
+{
+#ifdef CPPLINQ_PROFILE
+inline QueryProfile*& currentProfile()
+{
+    thread_local QueryProfile* profile = nullptr;
+    return profile;
+}
+
+// Makes the workers of a parallel operator count into the caller's query.
+class AllocationScope
+{
+public:
+    explicit AllocationScope(AllocationCounter* counter) : m_previous(currentAllocations())
     {
-        auto cond = [&](const auto& o) -> bool { return condition(o.var1, o.var2, o.var3, o.var4); };
-        CppLinq<T1, T2, T3, T4, decltype(cond)> linq(m_data, cond);
-        return linq;
+        currentAllocations() = counter;
     }
 
-    template <typename GetOrderKey>    
-    auto& orderBy(GetOrderKey getOrderKey, Order order = Order::Ascend)
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+
+    ~AllocationScope()
     {
-        auto sortFunc = [&](const auto& l, const auto& r){ 
-                auto lKey = getOrderKey(l.var1, l.var2, l.var3, l.var4);
-                auto rKey = getOrderKey(r.var1, r.var2, r.var3, r.var4);
-                return order == Order::Ascend ? lKey < rKey : lKey > rKey;
-            };
-        std::sort(super::m_begin, super::m_end, sortFunc);
-        return *this;
+        currentAllocations() = m_previous;
     }
 
-    template <typename SelectFunc>
-    auto select(SelectFunc selectFunc)
+    static AllocationCounter* current()
     {
-        using ReturnType = decltype(selectFunc(std::declval<const T1&, const T2&, const T3&, const T4&>()));
-        std::vector<ReturnType> result;
-        size_t count = super::m_takeCount;
-        for (const auto& ele : *this)
-        {
-            if (count--)
-                result.push_back(selectFunc(ele.var1, ele.var2, ele.var3, ele.var4));
-            else
-                break;
-        }
-        return result;
+        return currentAllocations();
     }
-};
 
-template <typename T1, typename T2, typename T3>
-struct Data<T1, T2, T3>
+private:
+    AllocationCounter* m_previous;
+};
+#else
+struct AllocationScope
+{
+    explicit AllocationScope(void*) {}
+    static void* current() { return nullptr; }
+};
+#endif
+};
+
+#ifdef CPPLINQ_PROFILE
+// While it exists, the operators and parallel morsels of every query are
+// written to path as Chrome trace events, for chrome://tracing or Perfetto.
+// Keep it alive until the traced queries have finished.
+class ChromeTrace
+{
+public:
+    explicit ChromeTrace(const std::string& path)
+        : m_file(std::fopen(path.c_str(), "w")), m_start(std::chrono::steady_clock::now())
+    {
+        if (m_file == nullptr)
+            throw std::runtime_error("cpplinq: cannot open " + path);
+        std::fputs("[\n", m_file);
+        instance().store(this);
+    }
+
+    ChromeTrace(const ChromeTrace&) = delete;
+    ChromeTrace& operator=(const ChromeTrace&) = delete;
+
+    ~ChromeTrace()
+    {
+        ChromeTrace* self = this;
+        instance().compare_exchange_strong(self, nullptr);
+        std::fputs("\n]\n", m_file);
+        std::fclose(m_file);
+    }
+
+    static ChromeTrace* current()
+    {
+        return instance().load(std::memory_order_acquire);
+    }
+
+    void begin(const char* name)
+    {
+        event(name, 'B', "");
+    }
+
+    void end(const char* name, const StageProfile* stage)
+    {
+        char args[160] = "";
+        if (stage != nullptr)
+        {
+            std::snprintf(args, sizeof(args), ",\"args\":{\"engine\":\"%s\",\"rows in\":%zu,\"rows out\":%zu}",
+                stage->engine.c_str(), stage->rowsIn, stage->rowsOut);
+        }
+        event(name, 'E', args);
+    }
+
+private:
+    void event(const char* name, char phase, const char* args)
+    {
+        const double ts = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - m_start).count();
+        char line[320];
+        std::snprintf(line, sizeof(line), "{\"name\":\"%s\",\"cat\":\"cpplinq\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%zu%s}",
+            name, phase, ts, threadId(), args);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_first)
+            std::fputs(",\n", m_file);
+        std::fputs(line, m_file);
+        m_first = false;
+    }
+
+    static size_t threadId()
+    {
+        static std::atomic<size_t> next(1);
+        thread_local size_t id = next++;
+        return id;
+    }
+
+    static std::atomic<ChromeTrace*>& instance()
+    {
+        static std::atomic<ChromeTrace*> trace(nullptr);
+        return trace;
+    }
+
+    std::FILE* m_file;
+    std::chrono::steady_clock::time_point m_start;
+    std::mutex m_mutex;
+    bool m_first = true;
+};
+#endif
+
+namespace detail
+{
+#ifdef CPPLINQ_PROFILE
+// Times one operator run, counts its allocations and records it in the
+// profile of the enclosing analyze() call and in the active ChromeTrace, if any.
+class Probe
+{
+public:
+    explicit Probe(const char* op)
+        : m_profile(currentProfile()), m_trace(ChromeTrace::current()), m_allocations(currentAllocations()), m_op(op)
+    {
+        if (m_profile == nullptr && m_trace == nullptr)
+            return;
+        if (m_allocations != nullptr)
+        {
+            m_startAllocations = m_allocations->allocations;
+            m_startBytes = m_allocations->bytes;
+            m_startLive = m_allocations->live;
+            m_outerPeak = m_allocations->peak.exchange(m_startLive);
+        }
+        if (m_profile != nullptr)
+        {
+            m_index = m_profile->stages.size();
+            m_profile->stages.push_back(StageProfile());
+        }
+        if (m_trace != nullptr)
+            m_trace->begin(op);
+        m_stage.op = op;
+        m_previous = current();
+        current() = this;
+        m_start = std::chrono::steady_clock::now();
+    }
+
+    Probe(const Probe&) = delete;
+    Probe& operator=(const Probe&) = delete;
+
+    ~Probe()
+    {
+        if (m_profile == nullptr && m_trace == nullptr)
+            return;
+        m_stage.nanoseconds = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - m_start).count());
+        if (m_allocations != nullptr)
+        {
+            const int64_t peak = m_allocations->peak;
+            m_stage.allocations = m_allocations->allocations - m_startAllocations;
+            m_stage.bytes = m_allocations->bytes - m_startBytes;
+            m_stage.peakBytes = size_t(std::max<int64_t>(peak - m_startLive, 0));
+            m_allocations->peak = std::max(peak, m_outerPeak);
+        }
+        if (m_trace != nullptr)
+            m_trace->end(m_op, &m_stage);
+        if (m_profile != nullptr)
+            m_profile->stages[m_index] = m_stage;
+        current() = m_previous;
+    }
+
+    void engine(const char* engine) { m_stage.engine = engine; }
+    void rowsIn(size_t count) { m_stage.rowsIn = count; }
+    void rowsOut(size_t count) { m_stage.rowsOut = count; }
+
+    // Counts the buffer of a result handed to the caller, which does not go
+    // through the counting allocator, as one allocation.
+    void output(size_t bytes)
+    {
+        if (m_allocations != nullptr && bytes != 0)
+            m_allocations->allocate(bytes);
+    }
+
+    // Lets an algorithm name the variant it picked for the running operator.
+    static void refine(const char* engine)
+    {
+        if (current() != nullptr)
+            current()->engine(engine);
+    }
+
+private:
+    static Probe*& current()
+    {
+        thread_local Probe* probe = nullptr;
+        return probe;
+    }
+
+    QueryProfile* m_profile;
+    ChromeTrace* m_trace;
+    AllocationCounter* m_allocations;
+    const char* m_op;
+    StageProfile m_stage;
+    Probe* m_previous = nullptr;
+    size_t m_index = 0;
+    size_t m_startAllocations = 0;
+    size_t m_startBytes = 0;
+    int64_t m_startLive = 0;
+    int64_t m_outerPeak = 0;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// Trace-only span, for work such as parallel morsels that is not an operator.
+class Span
+{
+public:
+    explicit Span(const char* name) : m_trace(ChromeTrace::current()), m_name(name)
+    {
+        if (m_trace != nullptr)
+            m_trace->begin(name);
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+    ~Span()
+    {
+        if (m_trace != nullptr)
+            m_trace->end(m_name, nullptr);
+    }
+
+private:
+    ChromeTrace* m_trace;
+    const char* m_name;
+};
+
+template <typename Query, typename Terminal>
+auto analyze(Query& query, Terminal terminal)
+{
+    QueryProfile profile;
+    AllocationCounter allocations;
+    auto result = [&]() {
+        QueryProfile* previous = currentProfile();
+        currentProfile() = &profile;
+        AllocationScope scope(&allocations);
+        try
+        {
+            auto result = terminal(query);
+            currentProfile() = previous;
+            return result;
+        }
+        catch (...)
+        {
+            currentProfile() = previous;
+            throw;
+        }
+    }();
+    profile.allocations = allocations.allocations;
+    profile.bytes = allocations.bytes;
+    profile.peakBytes = size_t(std::max<int64_t>(allocations.peak, 0));
+    return std::make_pair(std::move(result), std::move(profile));
+}
+#else
+struct Probe
+{
+    explicit Probe(const char*) {}
+    void engine(const char*) {}
+    void rowsIn(size_t) {}
+    void rowsOut(size_t) {}
+    void output(size_t) {}
+    static void refine(const char*) {}
+};
+
+struct Span
+{
+    explicit Span(const char*) {}
+};
+#endif
+
+// RightPushdown is false for joins whose matches depend on which right rows
+// exist, such as an as-of join, where a right-only condition must run on the
+// matches rather than filter the right input.
+template <typename Algorithm, bool RightPushdown = true>
+struct JoinEngine
+{
+    static constexpr bool rightPushdown = RightPushdown;
+
+    const char* name;
+    Algorithm algorithm;
+
+    template <typename Left, typename Right, typename Sink>
+    void operator()(const Left& left, const Right& right, Sink& sink)
+    {
+        algorithm(left, right, sink);
+    }
+};
+};
+
+template <typename... Types>
+class CppLinq;
+
+template <typename... Types>
+struct Data;
+
+namespace detail
+{
+// Calls func with the fields of a row, so one algorithm serves every stage.
+template <typename Func, typename T, typename... Extra>
+decltype(auto) call(Func&& func, const T& o, const Extra&... extra)
+{
+    return func(o, extra...);
+}
+
+template <typename Func, typename T1, typename T2, typename... Extra>
+decltype(auto) call(Func&& func, const Data<T1, T2>& o, const Extra&... extra)
+{
+    return func(o.var1, o.var2, extra...);
+}
+
+template <typename Func, typename T1, typename T2, typename T3, typename... Extra>
+decltype(auto) call(Func&& func, const Data<T1, T2, T3>& o, const Extra&... extra)
+{
+    return func(o.var1, o.var2, o.var3, extra...);
+}
+
+template <typename Func, typename T1, typename T2, typename T3, typename T4, typename... Extra>
+decltype(auto) call(Func&& func, const Data<T1, T2, T3, T4>& o, const Extra&... extra)
+{
+    return func(o.var1, o.var2, o.var3, o.var4, extra...);
+}
+
+template <typename T, typename U>
+Data<T, U> append(const T& o, const U& u)
+{
+    return { o, u };
+}
+
+template <typename T1, typename T2, typename U>
+Data<T1, T2, U> append(const Data<T1, T2>& o, const U& u)
+{
+    return { o.var1, o.var2, u };
+}
+
+template <typename T1, typename T2, typename T3, typename U>
+Data<T1, T2, T3, U> append(const Data<T1, T2, T3>& o, const U& u)
+{
+    return { o.var1, o.var2, o.var3, u };
+}
+
+struct NoKey {};
+
+template <typename Ts>
+struct NoTolerance
+{
+    bool operator()(const Ts&, const Ts&) const { return true; }
+};
+
+template <typename Ts, typename Distance>
+struct Tolerance
+{
+    Distance distance;
+    bool operator()(const Ts& l, const Ts& r) const { return l - r <= distance; }
+};
+
+template <typename Ts>
+void sortByTime(Vector<std::pair<Ts, size_t>>& keys)
+{
+    auto byTime = [](const std::pair<Ts, size_t>& l, const std::pair<Ts, size_t>& r){ return l.first < r.first; };
+    if (!std::is_sorted(keys.begin(), keys.end(), byTime))
+    {
+        std::stable_sort(keys.begin(), keys.end(), byTime);
+    }
+}
+
+template <typename T>
+constexpr size_t blockSize()
+{
+    return sizeof(T) >= CPPLINQ_BLOCK_BYTES ? 1 : CPPLINQ_BLOCK_BYTES / sizeof(T);
+}
+
+inline size_t threadCount(size_t requested)
+{
+    if (requested != 0)
+        return requested;
+    size_t hardware = std::thread::hardware_concurrency();
+    return hardware == 0 ? 1 : hardware;
+}
+
+// Runs func(0) ... func(count - 1) on up to threads workers; the first
+// exception thrown by a task is rethrown on the calling thread.
+template <typename Func>
+void parallelFor(size_t count, size_t threads, Func func)
+{
+    if (threads <= 1 || count <= 1)
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            checkpoint();
+            Span span("morsel");
+            func(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    std::exception_ptr error;
+    std::mutex errorMutex;
+    const StopCondition* stop = currentStop();
+    auto allocations = AllocationScope::current();
+    auto worker = [&]() {
+        try
+        {
+            StopScope scope(stop);
+            AllocationScope allocationScope(allocations);
+            for (size_t i = next++; i < count; i = next++)
+            {
+                checkpoint();
+                Span span("morsel");
+                func(i);
+            }
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!error)
+                error = std::current_exception();
+            next = count;
+        }
+    };
+
+    Vector<std::thread> workers;
+    for (size_t i = 1; i < std::min(threads, count); i++)
+    {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& t : workers)
+    {
+        t.join();
+    }
+    if (error)
+        std::rethrow_exception(error);
+}
+
+// Hands matched index pairs to sink in order until it asks for no more.
+template <typename Sink>
+bool emit(const Vector<std::pair<size_t, size_t>>& pairs, Sink& sink)
+{
+    for (const auto& p : pairs)
+    {
+        if (!sink(p.first, p.second))
+            return false;
+    }
+    return true;
+}
+
+// Nested loop join over cache-sized tiles: every inner tile is tested against
+// a whole outer tile while it is resident, instead of streaming the inner
+// input once per outer row. Outer tiles are independent and run in parallel,
+// one wave of tiles per thread, so a satisfied sink stops the join early.
+template <typename Row, typename T, typename Condition, typename Sink>
+void blockedNestedLoopJoin(const Vector<const Row*>& left,
+    const Vector<const T*>& right, Condition& condition, size_t threads, Sink& sink)
+{
+    const size_t outerBlock = blockSize<Row>();
+    const size_t innerBlock = blockSize<T>();
+    const size_t blocks = (left.size() + outerBlock - 1) / outerBlock;
+
+    for (size_t wave = 0; wave < blocks; wave += threads)
+    {
+        Vector<Vector<std::pair<size_t, size_t>>> results(std::min(threads, blocks - wave));
+        parallelFor(results.size(), threads, [&](size_t k) {
+            const size_t outerBegin = (wave + k) * outerBlock;
+            const size_t outerEnd = std::min(outerBegin + outerBlock, left.size());
+            auto& pairs = results[k];
+            for (size_t innerBegin = 0; innerBegin < right.size(); innerBegin += innerBlock)
+            {
+                const size_t innerEnd = std::min(innerBegin + innerBlock, right.size());
+                for (size_t i = outerBegin; i < outerEnd; i++)
+                {
+                    const Row& ele = *left[i];
+                    for (size_t j = innerBegin; j < innerEnd; j++)
+                    {
+                        if (call(condition, ele, *right[j]))
+                        {
+                            pairs.push_back({ i, j });
+                        }
+                    }
+                }
+            }
+            if (innerBlock < right.size())
+            {
+                std::stable_sort(pairs.begin(), pairs.end(),
+                    [](const std::pair<size_t, size_t>& l, const std::pair<size_t, size_t>& r){ return l.first < r.first; });
+            }
+        });
+
+        for (const auto& pairs : results)
+        {
+            if (!emit(pairs, sink))
+                return;
+        }
+    }
+}
+
+template <typename Key>
+struct HashEntry
+{
+    uint64_t hash;
+    Key key;
+    size_t index;
+};
+
+// Scatters entries into 2^bits partitions on the top hash bits. Each worker
+// histograms its own chunk first, so the scatter needs no locking and every
+// partition keeps the input order.
+template <typename Key>
+Vector<HashEntry<Key>> radixPartition(const Vector<HashEntry<Key>>& entries, int bits,
+    Vector<size_t>& bounds, size_t threads)
+{
+    const size_t partitions = size_t(1) << bits;
+    const size_t chunks = std::max<size_t>(1, std::min(threads, entries.size() / 4096));
+    const size_t chunkSize = (entries.size() + chunks - 1) / chunks;
+    auto partitionOf = [bits](uint64_t hash) { return bits == 0 ? 0 : size_t(hash >> (64 - bits)); };
+
+    Vector<Vector<size_t>> offsets(chunks, Vector<size_t>(partitions, 0));
+    parallelFor(chunks, threads, [&](size_t chunk) {
+        const size_t end = std::min(entries.size(), (chunk + 1) * chunkSize);
+        for (size_t i = chunk * chunkSize; i < end; i++)
+        {
+            offsets[chunk][partitionOf(entries[i].hash)]++;
+        }
+    });
+
+    bounds.assign(partitions + 1, 0);
+    size_t offset = 0;
+    for (size_t p = 0; p < partitions; p++)
+    {
+        bounds[p] = offset;
+        for (size_t chunk = 0; chunk < chunks; chunk++)
+        {
+            size_t count = offsets[chunk][p];
+            offsets[chunk][p] = offset;
+            offset += count;
+        }
+    }
+    bounds[partitions] = offset;
+
+    Vector<HashEntry<Key>> result(entries.size());
+    parallelFor(chunks, threads, [&](size_t chunk) {
+        const size_t end = std::min(entries.size(), (chunk + 1) * chunkSize);
+        for (size_t i = chunk * chunkSize; i < end; i++)
+        {
+            result[offsets[chunk][partitionOf(entries[i].hash)]++] = entries[i];
+        }
+    });
+    return result;
+}
+
+// Partitions both inputs until every build partition fits in cache, then
+// joins each partition pair with its own small chained table.
+template <typename Key>
+Vector<std::pair<size_t, size_t>> radixHashJoin(const Vector<HashEntry<Key>>& leftEntries,
+    const Vector<HashEntry<Key>>& rightEntries, size_t threads)
+{
+    const size_t npos = SIZE_MAX;
+    int bits = 0;
+    while (bits < 16 && (rightEntries.size() * sizeof(HashEntry<Key>) >> bits) > CPPLINQ_PARTITION_BYTES)
+    {
+        bits++;
+    }
+
+    Vector<size_t> leftBounds;
+    Vector<size_t> rightBounds;
+    auto lefts = radixPartition(leftEntries, bits, leftBounds, threads);
+    auto rights = radixPartition(rightEntries, bits, rightBounds, threads);
+
+    const size_t partitions = size_t(1) << bits;
+    Vector<Vector<std::pair<size_t, size_t>>> results(partitions);
+    parallelFor(partitions, threads, [&](size_t p) {
+        const size_t rightBegin = rightBounds[p];
+        const size_t rightCount = rightBounds[p + 1] - rightBegin;
+        if (rightCount == 0 || leftBounds[p] == leftBounds[p + 1])
+            return;
+
+        size_t buckets = 1;
+        while (buckets < rightCount)
+        {
+            buckets <<= 1;
+        }
+        Vector<size_t> heads(buckets, npos);
+        Vector<size_t> next(rightCount);
+        for (size_t j = rightCount; j-- > 0;)
+        {
+            size_t& head = heads[rights[rightBegin + j].hash & (buckets - 1)];
+            next[j] = head;
+            head = j;
+        }
+
+        auto& pairs = results[p];
+        for (size_t i = leftBounds[p]; i < leftBounds[p + 1]; i++)
+        {
+            const HashEntry<Key>& l = lefts[i];
+            for (size_t j = heads[l.hash & (buckets - 1)]; j != npos; j = next[j])
+            {
+                const HashEntry<Key>& r = rights[rightBegin + j];
+                if (r.hash == l.hash && r.key == l.key)
+                {
+                    pairs.push_back({ l.index, r.index });
+                }
+            }
+        }
+    });
+
+    Vector<std::pair<size_t, size_t>> pairs;
+    for (auto& result : results)
+    {
+        pairs.insert(pairs.end(), result.begin(), result.end());
+    }
+    return pairs;
+}
+
+template <typename Key>
+struct DenseRange
+{
+    Key min;
+    size_t size;
+
+    size_t slot(const Key& key) const
+    {
+        if constexpr (std::is_integral<Key>::value)
+            return size_t(uint64_t(key) - uint64_t(min));
+        else
+            return SIZE_MAX;
+    }
+
+    bool contains(const Key& key) const
+    {
+        return !(key < min) && slot(key) < size;
+    }
+};
+
+// Integral keys spanning at most slotsPerKey slots per key can be looked up
+// with one array index instead of a hash table probe.
+template <typename Key>
+bool findDenseRange(const Vector<Key>& keys, size_t slotsPerKey, DenseRange<Key>& range)
+{
+    if constexpr (std::is_integral<Key>::value)
+    {
+        if (keys.empty())
+            return false;
+        auto bounds = std::minmax_element(keys.begin(), keys.end());
+        uint64_t span = uint64_t(*bounds.second) - uint64_t(*bounds.first);
+        if (span >= slotsPerKey * keys.size() + 1024)
+            return false;
+        range = { *bounds.first, size_t(span) + 1 };
+        return true;
+    }
+    return false;
+}
+
+// Stable counting sort by left index: restores the order of a nested loop join.
+inline void sortByLeft(Vector<std::pair<size_t, size_t>>& pairs, size_t leftCount)
+{
+    Vector<size_t> offsets(leftCount + 1, 0);
+    for (const auto& p : pairs)
+    {
+        offsets[p.first + 1]++;
+    }
+    for (size_t i = 1; i <= leftCount; i++)
+    {
+        offsets[i] += offsets[i - 1];
+    }
+    Vector<std::pair<size_t, size_t>> sorted(pairs.size());
+    for (const auto& p : pairs)
+    {
+        sorted[offsets[p.first]++] = p;
+    }
+    pairs.swap(sorted);
+}
+
+// Equi-join building a chained hash table on the right input and probing it
+// with the left rows; matches come out in nested loop join order. Both keys
+// are converted to their common type, so they compare as == would.
+template <typename Row, typename T, typename GetLeftKey, typename GetRightKey, typename Sink>
+void hashJoin(const Vector<const Row*>& left, const Vector<const T*>& right,
+    GetLeftKey& getLeftKey, GetRightKey& getRightKey, JoinHint hint, size_t threads, Sink& sink)
+{
+    using LeftKey = typename std::decay<decltype(call(getLeftKey, std::declval<const Row&>()))>::type;
+    using RightKey = typename std::decay<decltype(getRightKey(std::declval<const T&>()))>::type;
+    using Key = typename std::common_type<LeftKey, RightKey>::type;
+    const size_t npos = SIZE_MAX;
+
+    Vector<Key> rightKeys(right.size());
+    for (size_t j = 0; j < right.size(); j++)
+    {
+        rightKeys[j] = getRightKey(*right[j]);
+    }
+
+    DenseRange<Key> range;
+    const bool direct = (hint & JoinHint::DirectAddress) != 0;
+    if ((direct || !(hint & JoinHint::RadixPartition)) && findDenseRange(rightKeys, direct ? 16 : 2, range))
+    {
+        Probe::refine("hash join, direct-address array");
+        Vector<size_t> heads(range.size, npos);
+        Vector<size_t> next(right.size());
+        for (size_t j = right.size(); j-- > 0;)
+        {
+            size_t& head = heads[range.slot(rightKeys[j])];
+            next[j] = head;
+            head = j;
+        }
+
+        for (size_t i = 0; i < left.size(); i++)
+        {
+            if (i % CPPLINQ_BATCH_SIZE == 0)
+                checkpoint();
+            Key key = call(getLeftKey, *left[i]);
+            if (!range.contains(key))
+                continue;
+            for (size_t j = heads[range.slot(key)]; j != npos; j = next[j])
+            {
+                if (!sink(i, j))
+                    return;
+            }
+        }
+        return;
+    }
+
+    if (hint & JoinHint::RadixPartition)
+    {
+        Probe::refine(hint & JoinHint::BloomFilter ? "hash join, radix partitioned, bloom" : "hash join, radix partitioned");
+        Vector<HashEntry<Key>> leftEntries(left.size());
+        Vector<HashEntry<Key>> rightEntries(right.size());
+        parallelFor(2, threads, [&](size_t side) {
+            if (side == 0)
+            {
+                for (size_t i = 0; i < left.size(); i++)
+                {
+                    Key key = call(getLeftKey, *left[i]);
+                    leftEntries[i] = { mix(std::hash<Key>()(key)), key, i };
+                }
+            }
+            else
+            {
+                for (size_t j = 0; j < right.size(); j++)
+                {
+                    rightEntries[j] = { mix(std::hash<Key>()(rightKeys[j])), rightKeys[j], j };
+                }
+            }
+        });
+
+        if (hint & JoinHint::BloomFilter)
+        {
+            BlockedBloomFilter<Key> filter(rightEntries.size());
+            for (const auto& e : rightEntries)
+            {
+                filter.insert(e.key);
+            }
+            leftEntries.erase(std::remove_if(leftEntries.begin(), leftEntries.end(),
+                [&](const HashEntry<Key>& e){ return !filter.mayContain(e.key); }), leftEntries.end());
+        }
+
+        auto pairs = radixHashJoin(leftEntries, rightEntries, threads);
+        sortByLeft(pairs, left.size());
+        emit(pairs, sink);
+        return;
+    }
+
+    Probe::refine(hint & JoinHint::BloomFilter ? "hash join, chained table, bloom" : "hash join, chained table");
+    HashMap<Key, size_t> heads(right.size());
+    Vector<size_t> next(right.size());
+    for (size_t j = right.size(); j-- > 0;)
+    {
+        auto inserted = heads.emplace(rightKeys[j], j);
+        next[j] = inserted.second ? npos : inserted.first->second;
+        inserted.first->second = j;
+    }
+
+    const bool useFilter = (hint & JoinHint::BloomFilter) != 0;
+    BlockedBloomFilter<Key> filter(useFilter ? heads.size() : 0);
+    if (useFilter)
+    {
+        for (const auto& head : heads)
+        {
+            filter.insert(head.first);
+        }
+    }
+
+    for (size_t i = 0; i < left.size(); i++)
+    {
+        if (i % CPPLINQ_BATCH_SIZE == 0)
+            checkpoint();
+        Key key = call(getLeftKey, *left[i]);
+        if (useFilter && !filter.mayContain(key))
+            continue;
+        auto found = heads.find(key);
+        for (size_t j = found == heads.end() ? npos : found->second; j != npos; j = next[j])
+        {
+            if (!sink(i, j))
+                return;
+        }
+    }
+}
+
+template <typename IterType>
+using IsRandomAccess = std::is_base_of<std::random_access_iterator_tag,
+    typename std::iterator_traits<IterType>::iterator_category>;
+
+// Single-pass iterators, such as those of fromSource(), expose every element
+// in the same reused slot, so a stage that keeps rows must copy them.
+template <typename IterType>
+using IsForward = std::is_base_of<std::forward_iterator_tag,
+    typename std::iterator_traits<IterType>::iterator_category>;
+
+template <typename IterType>
+using IsBidirectional = std::is_base_of<std::bidirectional_iterator_tag,
+    typename std::iterator_traits<IterType>::iterator_category>;
+
+// Vector-at-a-time scan: the condition fills a selection vector for a block of
+// CPPLINQ_BATCH_SIZE rows in a tight loop, then the consumer handles the
+// selected rows of the block at once.
+template <typename IterType, typename Condition, typename Consumer>
+void forEachBatch(IterType begin, IterType end, Condition& condition, Consumer consumer)
+{
+    uint32_t selection[CPPLINQ_BATCH_SIZE];
+    for (IterType base = begin; base != end;)
+    {
+        checkpoint();
+        const size_t n = std::min<size_t>(CPPLINQ_BATCH_SIZE, end - base);
+        size_t count = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            selection[count] = uint32_t(i);
+            count += condition(base[i]) ? 1 : 0;
+        }
+        if (!consumer(base, selection, count))
+            return;
+        base += n;
+    }
+}
+
+template <typename Row, typename T, typename GetKey, typename GetLow, typename GetHigh, typename Sink>
+void rangeJoin(const Vector<const Row*>& left, const Vector<const T*>& right,
+    GetKey& getKey, GetLow& getLow, GetHigh& getHigh, Sink& sink)
+{
+    using Key = typename std::decay<decltype(call(getKey, std::declval<const Row&>()))>::type;
+
+    Vector<std::pair<Key, size_t>> keys(left.size());
+    for (size_t i = 0; i < left.size(); i++)
+    {
+        keys[i] = { call(getKey, *left[i]), i };
+    }
+    std::sort(keys.begin(), keys.end());
+
+    Vector<std::pair<size_t, size_t>> pairs;
+    for (size_t j = 0; j < right.size(); j++)
+    {
+        if (j % CPPLINQ_BATCH_SIZE == 0)
+            checkpoint();
+        const auto& low = getLow(*right[j]);
+        const auto& high = getHigh(*right[j]);
+        auto match = std::lower_bound(keys.begin(), keys.end(), low,
+            [](const std::pair<Key, size_t>& l, const auto& r){ return l.first < r; });
+        for (; match != keys.end() && match->first < high; ++match)
+        {
+            pairs.push_back({ match->second, j });
+        }
+    }
+
+    sortByLeft(pairs, left.size());
+    emit(pairs, sink);
+}
+
+template <typename Row, typename T, typename GetLeftTs, typename GetRightTs, typename GetLeftBy, typename GetRightBy, typename Within, typename Sink>
+void asofJoin(const Vector<const Row*>& left, const Vector<const T*>& right,
+    GetLeftTs& getLeftTs, GetRightTs& getRightTs, GetLeftBy& getLeftBy, GetRightBy& getRightBy, const Within& within, Sink& sink)
+{
+    using Ts = typename std::decay<decltype(call(getLeftTs, std::declval<const Row&>()))>::type;
+    using Key = typename std::decay<decltype(getRightBy(std::declval<const T&>()))>::type;
+    const size_t npos = SIZE_MAX;
+
+    Vector<std::pair<Ts, size_t>> leftKeys(left.size());
+    for (size_t i = 0; i < left.size(); i++)
+    {
+        leftKeys[i] = { call(getLeftTs, *left[i]), i };
+    }
+    Vector<std::pair<Ts, size_t>> rightKeys(right.size());
+    for (size_t j = 0; j < right.size(); j++)
+    {
+        rightKeys[j] = { getRightTs(*right[j]), j };
+    }
+
+    sortByTime(leftKeys);
+    sortByTime(rightKeys);
+
+    Vector<size_t> matches(left.size(), npos);
+    using HashKey = typename std::conditional<std::is_same<Key, NoKey>::value, int, Key>::type;
+    HashMap<HashKey, size_t> lastByKey;
+    size_t last = npos;
+    size_t j = 0;
+    for (const auto& l : leftKeys)
+    {
+        for (; j < rightKeys.size() && !(l.first < rightKeys[j].first); j++)
+        {
+            if constexpr (std::is_same<Key, NoKey>::value)
+                last = j;
+            else
+                lastByKey[getRightBy(*right[rightKeys[j].second])] = j;
+        }
+
+        size_t candidate = last;
+        if constexpr (!std::is_same<Key, NoKey>::value)
+        {
+            auto found = lastByKey.find(call(getLeftBy, *left[l.second]));
+            candidate = found == lastByKey.end() ? npos : found->second;
+        }
+        if (candidate != npos && within(l.first, rightKeys[candidate].first))
+        {
+            matches[l.second] = rightKeys[candidate].second;
+        }
+    }
+
+    for (size_t i = 0; i < matches.size(); i++)
+    {
+        if (matches[i] != npos && !sink(i, matches[i]))
+            return;
+    }
+}
+
+template <typename Row>
+struct Arity
+{
+    static constexpr size_t value = 1;
+};
+
+template <typename... Types>
+struct Arity<Data<Types...>>
+{
+    static constexpr size_t value = sizeof...(Types);
+};
+
+struct Always
+{
+    template <typename... Args>
+    bool operator()(const Args&...) const
+    {
+        return true;
+    }
+};
+
+template <typename First, typename Second>
+struct Both
+{
+    First first;
+    Second second;
+
+    template <typename... Args>
+    bool operator()(const Args&... args) const
+    {
+        return first(args...) && second(args...);
+    }
+};
+
+template <typename First, typename Second>
+auto both(const First& first, const Second& second)
+{
+    if constexpr (std::is_same<First, Always>::value)
+        return second;
+    else
+        return Both<First, Second>{ first, second };
+}
+
+template <typename T, typename = void>
+struct InputsOf
+{
+    static constexpr unsigned value = ~0u;
+};
+
+template <typename T>
+struct InputsOf<T, typename std::enable_if<IsExpression<T>::value>::type>
+{
+    static constexpr unsigned value = T::inputs;
+};
+
+struct Unused {};
+
+// Evaluates an expression that reads only input Position on that input alone.
+template <size_t Position, typename Condition>
+struct AtInput
+{
+    Condition condition;
+
+    template <typename T>
+    bool operator()(const T& o) const
+    {
+        return call(std::make_index_sequence<Position - 1>(), o);
+    }
+
+    template <size_t... Is, typename T>
+    bool call(std::index_sequence<Is...>, const T& o) const
+    {
+        return condition((void(Is), Unused())..., o);
+    }
+};
+
+// Evaluates a condition on the first Count arguments only.
+template <size_t Count, typename Condition>
+struct Leading
+{
+    Condition condition;
+
+    template <typename... Args>
+    bool operator()(const Args&... args) const
+    {
+        return call(std::make_index_sequence<Count>(), std::forward_as_tuple(args...));
+    }
+
+    template <size_t... Is, typename Tuple>
+    bool call(std::index_sequence<Is...>, const Tuple& args) const
+    {
+        return condition(std::get<Is>(args)...);
+    }
+};
+
+// Evaluates a condition on the last argument only.
+template <typename Condition>
+struct Trailing
+{
+    Condition condition;
+
+    template <typename... Args>
+    bool operator()(const Args&... args) const
+    {
+        return condition(std::get<sizeof...(Args) - 1>(std::forward_as_tuple(args...)));
+    }
+};
+
+// Reads a member of whichever input is of the member's class. When several
+// inputs share the class, as in a self-join, the member pointer cannot tell
+// them apart and col<N>(&Class::member) has to name the input.
+template <typename Class, typename Member, typename First, typename... Rest>
+const Member& field(Member Class::*member, const First& first, const Rest&... rest)
+{
+    if constexpr (std::is_same<First, Class>::value)
+    {
+        static_assert((!std::is_same<Rest, Class>::value && ...),
+            "more than one input has this member's class; use col<N>(&Class::member) to pick the input");
+        return first.*member;
+    }
+    else
+    {
+        static_assert(sizeof...(Rest) != 0, "no input has this member");
+        return field(member, rest...);
+    }
+}
+
+template <typename Selector, typename... Args>
+decltype(auto) project(const Selector& selector, const Args&... args)
+{
+    if constexpr (std::is_member_object_pointer<Selector>::value)
+        return field(selector, args...);
+    else
+        return selector(args...);
+}
+
+// Builds a tuple from member pointers and expressions, so a select names the
+// fields it needs instead of a lambda that could read anything.
+template <typename... Selectors>
+struct Projection
+{
+    std::tuple<Selectors...> selectors;
+
+    template <typename... Args>
+    auto operator()(const Args&... args) const
+    {
+        return std::apply([&](const Selectors&... selector) { return std::make_tuple(project(selector, args...)...); }, selectors);
+    }
+};
+
+template <typename... Types>
+auto makeLinq(Vector<Data<Types...>>& rows)
+{
+    using Condition = DefaultCondition<Data<Types...>>;
+    return CppLinq<Types..., Condition>(rows, Condition());
+}
+
+};
+
+template <typename Left, typename IterType2, typename Algorithm, typename LeftFilter, typename RightFilter,
+    typename Residual, bool Skipped>
+class JoinLinq;
+
+template <typename IterType, typename RealType, typename WhereCondition = DefaultCondition<ElementType<IterType>>>
+class Base
+{
+    static constexpr bool filtered = !std::is_same<WhereCondition, DefaultCondition<ElementType<IterType>>>::value;
+
+public:
+    Base(WhereCondition condition) : m_condition(condition) {}
+
+    Base(IterType begin, IterType end)
+    {
+        m_begin = begin;
+        m_end = end;
+    }
+
+    Base(IterType begin, IterType end, WhereCondition condition) : m_condition(condition)
+    {
+        m_begin = begin;
+        m_end = end;
+    }
+
+    const auto& first()
+    {
+        auto it = begin();
+        if (m_takeCount == 0 || it == end())
+            throw std::out_of_range("cpplinq: first on an empty range");
+        return *it;
+    }
+
+    // Random-access sources without a condition index the last row and other
+    // bidirectional sources scan back from the end; with take() or a forward
+    // source it takes a forward scan. Throws when no row is left.
+    const auto& last()
+    {
+        if constexpr (!filtered && detail::IsRandomAccess<IterType>::value)
+        {
+            if (const size_t rows = expectedRows())
+                return begin()[rows - 1];
+        }
+        else
+        {
+            if constexpr (detail::IsBidirectional<IterType>::value)
+            {
+                auto first = begin(), last = end();
+                if (m_takeCount == SIZE_MAX && first != last)
+                    return *std::prev(last);
+            }
+
+            const ElementType<IterType>* result = nullptr;
+            size_t rows = 0;
+            for (auto it = begin(), last = end(); it != last && rows < m_takeCount; ++it, ++rows)
+            {
+                result = &*it;
+            }
+            if (result)
+                return *result;
+        }
+        throw std::out_of_range("cpplinq: last on an empty range");
+    }
+
+    // The index-th row after the skipped ones, in O(1) for random-access
+    // sources without a condition.
+    const auto& elementAt(size_t index)
+    {
+        if constexpr (!filtered && detail::IsRandomAccess<IterType>::value)
+        {
+            if (index < expectedRows())
+                return begin()[index];
+        }
+        else if (index < m_takeCount)
+        {
+            size_t i = 0;
+            for (auto it = begin(), last = end(); it != last; ++it, ++i)
+            {
+                if (i == index)
+                    return *it;
+            }
+        }
+        throw std::out_of_range("cpplinq: elementAt index " + std::to_string(index) + " out of range");
+    }
+
+    bool any()
+    {
+        detail::Probe probe("any");
+        bool found = false;
+        scan(probe, std::min<size_t>(m_takeCount, 1), [&](const auto&) { found = true; });
+        return found;
+    }
+
+    size_t count()
+    {
+        detail::Probe probe("count");
+        if constexpr (!filtered && detail::IsRandomAccess<IterType>::value)
+        {
+            const size_t count = expectedRows();
+            probe.engine("range size");
+            probe.rowsIn(size_t(m_end - m_begin));
+            probe.rowsOut(count);
+            return count;
+        }
+        size_t count = 0;
+        scan<true>(probe, m_takeCount, [&](const auto&) { count++; });
+        return count;
+    }
+
+    auto sum()
+    {
+        detail::Probe probe("sum");
+        ElementType<IterType> sum = 0;
+        scan<true>(probe, m_takeCount, [&](const auto& element) { sum += element; });
+        return sum;
+    }
+
+    auto average()
+    {
+        detail::Probe probe("average");
+        ElementType<IterType> sum = 0;
+        int count = 0;
+        scan<true>(probe, m_takeCount, [&](const auto& element) {
+            sum += element;
+            count++;
+        });
+        return sum / (ElementType<IterType>)count;
+    }
+
+    template <typename Class, typename Member>
+    auto select(Member Class::*member)
+    {
+        return ((RealType*)this)->select(detail::Projection<Member Class::*>{ { member } });
+    }
+
+    template <typename First, typename Second, typename... Rest>
+    auto select(First first, Second second, Rest... rest)
+    {
+        return ((RealType*)this)->select(detail::Projection<First, Second, Rest...>{ { first, second, rest... } });
+    }
+
+    RealType& take(size_t count)
+    {
+        m_takeCount = count;
+        return *(RealType*)this;
+    }
+
+    size_t takeCount() const
+    {
+        return m_takeCount;
+    }
+
+    RealType& skip(size_t count)
+    {
+        m_skipCount = count;
+        return *(RealType*)this;
+    }
+
+    RealType& parallel(size_t threadCount = 0)
+    {
+        m_threadCount = detail::threadCount(threadCount);
+        return *(RealType*)this;
+    }
+
+    template <typename IterType2, typename JoinCondition>
+    auto join(IterType2 begin2, IterType2 end2, JoinCondition condition)
+    {
+        const size_t threads = m_threadCount;
+        return makeJoin(begin2, end2, "blocked nested loop", [condition, threads](const auto& left, const auto& right, auto& sink) mutable {
+            detail::blockedNestedLoopJoin(left, right, condition, threads, sink);
+        });
+    }
+
+    template <typename IterType2, typename GetLeftKey, typename GetRightKey>
+    auto hashJoin(IterType2 begin2, IterType2 end2, GetLeftKey getLeftKey, GetRightKey getRightKey, JoinHint hint = JoinHint::NoHint)
+    {
+        const size_t threads = m_threadCount;
+        return makeJoin(begin2, end2, "hash join", [getLeftKey, getRightKey, hint, threads](const auto& left, const auto& right, auto& sink) mutable {
+            detail::hashJoin(left, right, getLeftKey, getRightKey, hint, threads, sink);
+        });
+    }
+
+    // Folds the rows of every key into a value starting from init, in order of
+    // first appearance. Dense integral keys index an array instead of a hash table.
+    template <typename GetKey, typename Value, typename Aggregate>
+    auto groupBy(GetKey getKey, Value init, Aggregate aggregate)
+    {
+        using Row = ElementType<IterType>;
+        using Key = typename std::decay<decltype(detail::call(getKey, std::declval<const Row&>()))>::type;
+        const size_t npos = SIZE_MAX;
+
+        detail::Probe probe("groupBy");
+        std::vector<std::pair<Key, Value>> groups;
+        auto update = [&](size_t group, const Row& row) {
+            detail::call([&](const auto&... fields) { aggregate(groups[group].second, fields...); }, row);
+        };
+
+        // A single-pass source overwrites its row on every step, so each row
+        // is folded as it is read.
+        if constexpr (!detail::IsForward<IterType>::value)
+        {
+            probe.engine("hash table, single pass");
+            detail::HashMap<Key, size_t> slots;
+            size_t rowsIn = 0;
+            for (const auto& ele : *this)
+            {
+                if (rowsIn == m_takeCount)
+                    break;
+                auto inserted = slots.emplace(detail::call(getKey, ele), groups.size());
+                if (inserted.second)
+                {
+                    groups.push_back({ inserted.first->first, init });
+                }
+                update(inserted.first->second, ele);
+                rowsIn++;
+            }
+            probe.rowsIn(rowsIn);
+            probe.rowsOut(groups.size());
+            probe.output(groups.capacity() * sizeof(std::pair<Key, Value>));
+            return groups;
+        }
+
+        detail::Vector<const Row*> rows;
+        detail::Vector<Key> keys;
+        for (const auto& ele : *this)
+        {
+            if (rows.size() == m_takeCount)
+                break;
+            rows.push_back(&ele);
+            keys.push_back(detail::call(getKey, ele));
+        }
+
+        detail::DenseRange<Key> range;
+        if (detail::findDenseRange(keys, 2, range))
+        {
+            probe.engine("direct-address array");
+            detail::Vector<size_t> slots(range.size, npos);
+            for (size_t i = 0; i < rows.size(); i++)
+            {
+                size_t& group = slots[range.slot(keys[i])];
+                if (group == npos)
+                {
+                    group = groups.size();
+                    groups.push_back({ keys[i], init });
+                }
+                update(group, *rows[i]);
+            }
+        }
+        else
+        {
+            probe.engine("hash table");
+            detail::HashMap<Key, size_t> slots;
+            for (size_t i = 0; i < rows.size(); i++)
+            {
+                auto inserted = slots.emplace(keys[i], groups.size());
+                if (inserted.second)
+                {
+                    groups.push_back({ keys[i], init });
+                }
+                update(inserted.first->second, *rows[i]);
+            }
+        }
+        probe.rowsIn(rows.size());
+        probe.rowsOut(groups.size());
+        probe.output(groups.capacity() * sizeof(std::pair<Key, Value>));
+        return groups;
+    }
+
+    // Exports the keys of this query as a filter, e.g. to drop probe rows in
+    // an upstream where() before they are joined.
+    template <typename GetKey>
+    auto bloomFilter(GetKey getKey, size_t bitsPerKey = 10)
+    {
+        using Key = typename std::decay<decltype(detail::call(getKey, std::declval<const ElementType<IterType>&>()))>::type;
+        detail::Vector<Key> keys;
+        for (const auto& ele : *this)
+        {
+            if (keys.size() == m_takeCount)
+                break;
+            keys.push_back(detail::call(getKey, ele));
+        }
+        BlockedBloomFilter<Key> filter(keys.size(), bitsPerKey);
+        for (const auto& key : keys)
+        {
+            filter.insert(key);
+        }
+        return filter;
+    }
+
+    // Keeps pairs with getLow(right) <= getKey(left) < getHigh(right) in
+    // O((n + m) log n + matches), in the same order as the equivalent join().
+    template <typename IterType2, typename GetKey, typename GetLow, typename GetHigh>
+    auto rangeJoin(IterType2 begin2, IterType2 end2, GetKey getKey, GetLow getLow, GetHigh getHigh)
+    {
+        return makeJoin(begin2, end2, "range join, sorted keys", [getKey, getLow, getHigh](const auto& left, const auto& right, auto& sink) mutable {
+            detail::rangeJoin(left, right, getKey, getLow, getHigh, sink);
+        });
+    }
+
+    // Pairs every left row with the last right element whose timestamp is not
+    // after the left one, optionally within the same by-key and a tolerance.
+    template <typename IterType2, typename GetLeftTs, typename GetRightTs>
+    auto asofJoin(IterType2 begin2, IterType2 end2, GetLeftTs getLeftTs, GetRightTs getRightTs)
+    {
+        using Ts = typename std::decay<decltype(detail::call(getLeftTs, std::declval<const ElementType<IterType>&>()))>::type;
+        auto noKey = [](const auto&...){ return detail::NoKey(); };
+        return makeAsofJoin(begin2, end2, getLeftTs, getRightTs, noKey, noKey, detail::NoTolerance<Ts>());
+    }
+
+    template <typename IterType2, typename GetLeftTs, typename GetRightTs, typename Distance>
+    auto asofJoin(IterType2 begin2, IterType2 end2, GetLeftTs getLeftTs, GetRightTs getRightTs, Distance tolerance)
+    {
+        using Ts = typename std::decay<decltype(detail::call(getLeftTs, std::declval<const ElementType<IterType>&>()))>::type;
+        auto noKey = [](const auto&...){ return detail::NoKey(); };
+        return makeAsofJoin(begin2, end2, getLeftTs, getRightTs, noKey, noKey, detail::Tolerance<Ts, Distance>{ tolerance });
+    }
+
+    template <typename IterType2, typename GetLeftTs, typename GetRightTs, typename GetLeftBy, typename GetRightBy>
+    auto asofJoin(IterType2 begin2, IterType2 end2, GetLeftTs getLeftTs, GetRightTs getRightTs,
+        GetLeftBy getLeftBy, GetRightBy getRightBy)
+    {
+        using Ts = typename std::decay<decltype(detail::call(getLeftTs, std::declval<const ElementType<IterType>&>()))>::type;
+        return makeAsofJoin(begin2, end2, getLeftTs, getRightTs, getLeftBy, getRightBy, detail::NoTolerance<Ts>());
+    }
+
+    template <typename IterType2, typename GetLeftTs, typename GetRightTs, typename GetLeftBy, typename GetRightBy, typename Distance>
+    auto asofJoin(IterType2 begin2, IterType2 end2, GetLeftTs getLeftTs, GetRightTs getRightTs,
+        GetLeftBy getLeftBy, GetRightBy getRightBy, Distance tolerance)
+    {
+        using Ts = typename std::decay<decltype(detail::call(getLeftTs, std::declval<const ElementType<IterType>&>()))>::type;
+        return makeAsofJoin(begin2, end2, getLeftTs, getRightTs, getLeftBy, getRightBy, detail::Tolerance<Ts, Distance>{ tolerance });
+    }
+
+    // Describes the operators of this query and the engines they run on.
+    std::string explain()
+    {
+        using Row = ElementType<IterType>;
+        std::string plan;
+        if constexpr (detail::Arity<Row>::value > 1)
+            plan = "rows: " + std::to_string(m_end - m_begin) + " joined rows of " + std::to_string(sizeof(Row)) + " bytes\n";
+        else if constexpr (detail::IsRandomAccess<IterType>::value)
+            plan = "from: random-access range of " + std::to_string(m_end - m_begin) + " rows\n";
+        else
+            plan = "from: input range\n";
+
+        if (filtered)
+        {
+            bool batched = false;
+            if constexpr (detail::IsRandomAccess<IterType>::value)
+                batched = size_t(m_end - m_begin) >= CPPLINQ_BATCH_SIZE;
+            plan += batched ? "where: batched selection vectors\n" : "where: row at a time\n";
+        }
+        if (m_skipCount != 0)
+            plan += "skip: " + std::to_string(m_skipCount) + "\n";
+        if (m_takeCount != SIZE_MAX)
+            plan += "take: " + std::to_string(m_takeCount) + "\n";
+        if (m_threadCount > 1)
+            plan += "parallel: " + std::to_string(m_threadCount) + " threads\n";
+        return plan;
+    }
+
+#ifdef CPPLINQ_PROFILE
+    // Runs terminal(query) and returns its result with the rows, time and
+    // bytes of every operator that ran.
+    template <typename Terminal>
+    auto analyze(Terminal terminal)
+    {
+        return detail::analyze(*(RealType*)this, terminal);
+    }
+#endif
+
+    // Runs terminal(query) on another thread and returns its future. The
+    // query's scans check token and deadline between morsels and give up
+    // with QueryCancelled; the query is moved into the task.
+    template <typename Terminal>
+    auto runAsync(Terminal terminal, CancellationToken token = CancellationToken(),
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max())
+    {
+        return detail::runAsync(std::move(*(RealType*)this), terminal, token, deadline);
+    }
+
+    // The source's own iterators when there is no where(), so an unfiltered
+    // query keeps its iterator category.
+    typename QueryIterator<IterType, WhereCondition>::type begin()
+    {
+        if constexpr (filtered)
+        {
+            return iterator<IterType, WhereCondition>(m_begin, m_end, m_begin, m_condition) + m_skipCount;
+        }
+        else if constexpr (detail::IsRandomAccess<IterType>::value)
+        {
+            return m_begin + std::min(m_skipCount, size_t(m_end - m_begin));
+        }
+        else
+        {
+            IterType it = m_begin;
+            for (size_t i = 0; i < m_skipCount && it != m_end; i++)
+            {
+                ++it;
+            }
+            return it;
+        }
+    }
+
+    typename QueryIterator<IterType, WhereCondition>::type end()
+    {
+        if constexpr (filtered)
+            return iterator<IterType, WhereCondition>(m_begin, m_end, m_end, m_condition);
+        else
+            return m_end;
+    }
+
+protected:
+    // Calls func for at most take selected rows after the skipped ones. Large
+    // random-access inputs run batch by batch, and without a condition need no
+    // selection vector; small inputs and other iterators test the condition
+    // row at a time on the source's iterator. Fused consumers, the aggregates that only fold
+    // each row into a register, test the condition in the same loop instead
+    // of going through a selection vector when there is no skip or take.
+    template <bool Fused = false, typename Func>
+    void scan(detail::Probe& probe, size_t take, Func func)
+    {
+        const size_t limit = take;
+        if constexpr (!filtered && detail::IsRandomAccess<IterType>::value)
+        {
+            const size_t size = size_t(m_end - m_begin);
+            const size_t first = std::min(m_skipCount, size);
+            const size_t rows = std::min(take, size - first);
+            for (size_t done = 0; done < rows;)
+            {
+                detail::checkpoint();
+                const IterType base = m_begin + (first + done);
+                const size_t n = std::min<size_t>(CPPLINQ_BATCH_SIZE, rows - done);
+                for (size_t k = 0; k < n; k++)
+                {
+                    func(base[k]);
+                }
+                done += n;
+            }
+            probe.engine(size >= CPPLINQ_BATCH_SIZE ? "batched scan" : "row scan");
+            probe.rowsIn(first + rows);
+            probe.rowsOut(rows);
+            return;
+        }
+        else if constexpr (detail::IsRandomAccess<IterType>::value)
+        {
+            if (size_t(m_end - m_begin) >= CPPLINQ_BATCH_SIZE)
+            {
+                // Without skip or take every row is visited, so count, sum and
+                // average test the condition inline; with them the selection
+                // vectors find where the limit is reached.
+                if constexpr (Fused)
+                {
+                    if (m_skipCount == 0 && take == SIZE_MAX)
+                    {
+                        size_t rows = 0;
+                        for (IterType base = m_begin; base != m_end;)
+                        {
+                            detail::checkpoint();
+                            const IterType stop = base + std::min<size_t>(CPPLINQ_BATCH_SIZE, m_end - base);
+                            for (; base != stop; ++base)
+                            {
+                                if (m_condition(*base))
+                                {
+                                    func(*base);
+                                    rows++;
+                                }
+                            }
+                        }
+                        probe.engine("fused scan");
+                        probe.rowsIn(size_t(m_end - m_begin));
+                        probe.rowsOut(rows);
+                        return;
+                    }
+                }
+
+                size_t skip = m_skipCount;
+                size_t rowsIn = 0;
+                detail::forEachBatch(m_begin, m_end, m_condition, [&](IterType base, const uint32_t* selection, size_t count) {
+                    const size_t first = std::min(skip, count);
+                    const size_t last = count - first < take ? count : first + take;
+                    skip -= first;
+                    take -= last - first;
+                    rowsIn = size_t(base - m_begin) + CPPLINQ_BATCH_SIZE;
+                    for (size_t k = first; k < last; k++)
+                    {
+                        func(base[selection[k]]);
+                    }
+                    return take != 0;
+                });
+                probe.engine("batched scan");
+                probe.rowsIn(std::min(rowsIn, size_t(m_end - m_begin)));
+                probe.rowsOut(limit - take);
+                return;
+            }
+        }
+
+        probe.engine("row scan");
+        size_t skip = m_skipCount;
+        size_t rowsIn = 0;
+        size_t rows = 0;
+        for (IterType it = m_begin; take != 0 && it != m_end; ++it)
+        {
+            if (++rowsIn % CPPLINQ_BATCH_SIZE == 0)
+                detail::checkpoint();
+            if (!m_condition(*it))
+                continue;
+            if (skip != 0)
+            {
+                skip--;
+                continue;
+            }
+            func(*it);
+            rows++;
+            if (--take == 0)
+                break;
+        }
+        probe.rowsIn(rowsIn);
+        probe.rowsOut(rows);
+    }
+
+    // An upper bound on the rows a scan produces, where one is known without
+    // running it, for sizing its output; 0 otherwise. Exact for random-access
+    // sources without a condition.
+    size_t expectedRows()
+    {
+        if constexpr (detail::IsRandomAccess<IterType>::value)
+        {
+            const size_t size = size_t(m_end - m_begin);
+            if (!filtered)
+                return std::min(m_takeCount, size - std::min(m_skipCount, size));
+            if (m_takeCount < size)
+                return m_takeCount;
+        }
+        return 0;
+    }
+
+    template <bool RightPushdown = true, typename IterType2, typename Algorithm>
+    auto makeJoin(IterType2 begin2, IterType2 end2, const char* engine, Algorithm algorithm)
+    {
+        using Engine = detail::JoinEngine<Algorithm, RightPushdown>;
+        return JoinLinq<RealType, IterType2, Engine, detail::Always, detail::Always, detail::Always, false>(
+            std::move(*(RealType*)this), begin2, end2, Engine{ engine, algorithm }, detail::Always(), detail::Always(), detail::Always());
+    }
+
+    template <typename IterType2, typename GetLeftTs, typename GetRightTs, typename GetLeftBy, typename GetRightBy, typename Within>
+    auto makeAsofJoin(IterType2 begin2, IterType2 end2, GetLeftTs getLeftTs, GetRightTs getRightTs,
+        GetLeftBy getLeftBy, GetRightBy getRightBy, Within within)
+    {
+        return makeJoin<false>(begin2, end2, "as-of join, sorted merge", [=](const auto& left, const auto& right, auto& sink) mutable {
+            detail::asofJoin(left, right, getLeftTs, getRightTs, getLeftBy, getRightBy, within, sink);
+        });
+    }
+
+    IterType m_begin;
+    IterType m_end;
+    WhereCondition m_condition;
+    size_t m_takeCount = SIZE_MAX;
+    size_t m_skipCount = 0;
+    size_t m_threadCount = 1;
+};
+
+template <typename T1, typename T2, typename T3, typename T4>
+struct Data<T1, T2, T3, T4>
+{
+    T1 var1;
+    T2 var2;
+    T3 var3;
+    T4 var4;
+};
+
+template <typename T1, typename T2, typename T3, typename T4, typename WhereCondition>
+class CppLinq<T1, T2, T3, T4, WhereCondition> : public Base<
+    IteratorType<Data<T1,T2,T3,T4>>,
+    CppLinq<T1, T2, T3, T4, WhereCondition>,
+    WhereCondition>
+{
+    using super = Base<
+        IteratorType<Data<T1,T2,T3,T4>>,
+        CppLinq<T1, T2, T3, T4, WhereCondition>,
+        WhereCondition>;
+private:
+    detail::Vector<Data<T1, T2, T3, T4>> m_data;
+public:
+    CppLinq(detail::Vector<Data<T1, T2, T3, T4>>& v, WhereCondition condition) : super(condition)
+    {
+        std::swap(m_data, v);
+        super::m_begin = m_data.begin();
+        super::m_end = m_data.end();
+    }
+
+    CppLinq(const CppLinq& other) : super(other), m_data(other.m_data)
+    {
+        super::m_begin = m_data.begin();
+        super::m_end = m_data.end();
+    }
+
+    CppLinq(CppLinq&& other) : super(other), m_data(std::move(other.m_data))
+    {
+        super::m_begin = m_data.begin();
+        super::m_end = m_data.end();
+    }
+
+    void addData(const Data<T1, T2, T3, T4>& v)
+    {
+        m_data.push_back(v);
+        super::m_begin = m_data.begin();
+        super::m_end = m_data.end();
+    }
+
+    template <typename Condition2>
+    auto where(Condition2 condition)
+    {
+        auto cond = [condition](const auto& o) -> bool { return condition(o.var1, o.var2, o.var3, o.var4); };
+        CppLinq<T1, T2, T3, T4, decltype(cond)> linq(m_data, cond);
+        return linq;
+    }
+
+    template <typename GetOrderKey>    
+    auto& orderBy(GetOrderKey getOrderKey, Order order = Order::Ascend)
+    {
+        auto sortFunc = [&](const auto& l, const auto& r){ 
+                auto lKey = getOrderKey(l.var1, l.var2, l.var3, l.var4);
+                auto rKey = getOrderKey(r.var1, r.var2, r.var3, r.var4);
+                return order == Order::Ascend ? lKey < rKey : lKey > rKey;
+            };
+        detail::Probe probe("orderBy");
+        probe.engine("std::sort");
+        std::sort(super::m_begin, super::m_end, sortFunc);
+        probe.rowsIn(size_t(std::distance(super::m_begin, super::m_end)));
+        probe.rowsOut(size_t(std::distance(super::m_begin, super::m_end)));
+        return *this;
+    }
+
+    using super::select;
+
+    template <typename SelectFunc>
+    auto select(SelectFunc selectFunc)
+    {
+        using ReturnType = typename std::decay<decltype(selectFunc(std::declval<const T1&>(), std::declval<const T2&>(), std::declval<const T3&>(), std::declval<const T4&>()))>::type;
+        detail::Probe probe("select");
+        std::vector<ReturnType> result;
+        result.reserve(super::expectedRows());
+        super::scan(probe, super::m_takeCount, [&](const auto& ele) { result.push_back(selectFunc(ele.var1, ele.var2, ele.var3, ele.var4)); });
+        probe.output(result.capacity() * sizeof(ReturnType));
+        return result;
+    }
+};
+
+template <typename T1, typename T2, typename T3>
+struct Data<T1, T2, T3>
+{
+    T1 var1;
+    T2 var2;
+    T3 var3;
+};
+
+template <typename T1, typename T2, typename T3, typename WhereCondition>
+class CppLinq<T1, T2, T3, WhereCondition> : public Base<
+        IteratorType<Data<T1, T2, T3>>,
+        CppLinq<T1, T2, T3, WhereCondition>,
+        WhereCondition>
+{
+    using super = Base<
+        IteratorType<Data<T1, T2, T3>>,
+        CppLinq<T1, T2, T3, WhereCondition>,
+        WhereCondition>;
+private:
+    detail::Vector<Data<T1, T2, T3>> m_data;
+public:
+    CppLinq(detail::Vector<Data<T1, T2, T3>>& v, WhereCondition condition) : super(condition)
+    {
+        std::swap(m_data, v);
+        super::m_begin = m_data.begin();
+        super::m_end = m_data.end();
+    }
+
+    CppLinq(const CppLinq& other) : super(other), m_data(other.m_data)
+    {
+        super::m_begin = m_data.begin();
+        super::m_end = m_data.end();
+    }
+
+    CppLinq(CppLinq&& other) : super(other), m_data(std::move(other.m_data))
+    {
+        super::m_begin = m_data.begin();
+        super::m_end = m_data.end();
+    }
+
+    void addData(const Data<T1, T2, T3>& v)
+    {
+        m_data.push_back(v);
+        super::m_begin = m_data.begin();
+        super::m_end = m_data.end();
+    }
+
+    template <typename Condition2>
+    auto where(Condition2 condition)
+    {
+        auto cond = [condition](const auto& o) -> bool { return condition(o.var1, o.var2, o.var3); };
+        CppLinq<T1, T2, T3, decltype(cond)> linq(m_data, cond);
+        return linq;
+    }
+
+    template <typename GetOrderKey>    
+    auto& orderBy(GetOrderKey getOrderKey, Order order = Order::Ascend)
+    {
+        auto sortFunc = [&](const auto& l, const auto& r){ 
+                auto lKey = getOrderKey(l.var1, l.var2, l.var3);
+                auto rKey = getOrderKey(r.var1, r.var2, r.var3);
+                return order == Order::Ascend ? lKey < rKey : lKey > rKey;
+            };
+        detail::Probe probe("orderBy");
+        probe.engine("std::sort");
+        std::sort(super::m_begin, super::m_end, sortFunc);
+        probe.rowsIn(size_t(std::distance(super::m_begin, super::m_end)));
+        probe.rowsOut(size_t(std::distance(super::m_begin, super::m_end)));
+        return *this;
+    }
+
+    using super::select;
+
+    template <typename SelectFunc>
+    auto select(SelectFunc selectFunc)
+    {
+        using ReturnType = typename std::decay<decltype(selectFunc(std::declval<const T1&>(), std::declval<const T2&>(), std::declval<const T3&>()))>::type;
+        detail::Probe probe("select");
+        std::vector<ReturnType> result;
+        result.reserve(super::expectedRows());
+        super::scan(probe, super::m_takeCount, [&](const auto& ele) { result.push_back(selectFunc(ele.var1, ele.var2, ele.var3)); });
+        probe.output(result.capacity() * sizeof(ReturnType));
+        return result;
+    }
+};
+
+template <typename T1, typename T2>
+struct Data<T1, T2>
+{
+    T1 var1;
+    T2 var2;
+};
+    
+template <typename T1, typename T2, typename WhereCondition>
+class CppLinq<T1, T2, WhereCondition> 
+    : public Base<
+        IteratorType<Data<T1, T2>>,
+        CppLinq<T1, T2, WhereCondition>,
+        WhereCondition>
+{
+    using super = Base<
+        IteratorType<Data<T1, T2>>,
+        CppLinq<T1, T2, WhereCondition>,
+        WhereCondition>;
+private:
+    detail::Vector<Data<T1, T2>> m_data;
+public:
+    CppLinq(detail::Vector<Data<T1, T2>>& v, WhereCondition condition) : super(condition)
+    {
+        std::swap(m_data, v);
+        super::m_begin = m_data.begin();
+        super::m_end = m_data.end();
+    }
+
+    CppLinq(const CppLinq& other) : super(other), m_data(other.m_data)
+    {
+        super::m_begin = m_data.begin();
+        super::m_end = m_data.end();
+    }
+
+    CppLinq(CppLinq&& other) : super(other), m_data(std::move(other.m_data))
+    {
+        super::m_begin = m_data.begin();
+        super::m_end = m_data.end();
+    }
+
+    void addData(const Data<T1, T2>& v)
+    {
+        m_data.push_back(v);
+        super::m_begin = m_data.begin();
+        super::m_end = m_data.end();
+    }
+    
+    template <typename Condition2>
+    auto where(Condition2 condition)
+    {
+        auto cond = [condition](const auto& o) -> bool { return condition(o.var1, o.var2); };
+        CppLinq<T1, T2, decltype(cond)> linq(m_data, cond);
+        return linq;
+    }
+
+    template <typename GetOrderKey>    
+    auto& orderBy(GetOrderKey getOrderKey, Order order = Order::Ascend)
+    {
+        auto sortFunc = [&](const auto& l, const auto& r){ 
+                auto lKey = getOrderKey(l.var1, l.var2);
+                auto rKey = getOrderKey(r.var1, r.var2);
+                return order == Order::Ascend ? lKey < rKey : lKey > rKey;
+            };
+        detail::Probe probe("orderBy");
+        probe.engine("std::sort");
+        std::sort(super::m_begin, super::m_end, sortFunc);
+        probe.rowsIn(size_t(std::distance(super::m_begin, super::m_end)));
+        probe.rowsOut(size_t(std::distance(super::m_begin, super::m_end)));
+        return *this;
+    }
+
+    using super::select;
+
+    template <typename SelectFunc>
+    auto select(SelectFunc selectFunc)
+    {
+        using ReturnType = typename std::decay<decltype(selectFunc(std::declval<const T1&>(), std::declval<const T2&>()))>::type;
+        detail::Probe probe("select");
+        std::vector<ReturnType> result;
+        result.reserve(super::expectedRows());
+        super::scan(probe, super::m_takeCount, [&](const auto& ele) { result.push_back(selectFunc(ele.var1, ele.var2)); });
+        probe.output(result.capacity() * sizeof(ReturnType));
+        return result;
+    }
+    
+};
+
+template <typename IterType, typename WhereCondition>
+class CppLinq<IterType, WhereCondition> : public Base<IterType, CppLinq<IterType, WhereCondition>, WhereCondition>
 {
-    T1 var1;
-    T2 var2;
-    T3 var3;
+    using super = Base<IterType, CppLinq<IterType, WhereCondition>, WhereCondition>;
+public:
+    CppLinq(IterType begin, IterType end) : super(begin, end) {}
+    CppLinq(IterType begin, IterType end, WhereCondition condition) : super(begin, end, condition) {}
+
+    // source owns the elements and lives as long as any stage of the query.
+    CppLinq(IterType begin, IterType end, WhereCondition condition, std::shared_ptr<const void> source)
+        : super(begin, end, condition), m_source(std::move(source)) {}
+    
+    template <typename WhereCondition2>
+    CppLinq<IterType, WhereCondition2> where(WhereCondition2 condition)
+    {
+        CppLinq<IterType, WhereCondition2> linq(super::m_begin, super::m_end, condition, m_source); 
+        return linq;
+    }
+
+    template <typename GetOrderKey>    
+    auto& orderBy(GetOrderKey getOrderKey, Order order = Order::Ascend)
+    {
+        auto sortFunc = [&](const auto& l, const auto& r){ 
+                auto lKey = getOrderKey(l);
+                auto rKey = getOrderKey(r);
+                return order == Order::Ascend ? lKey < rKey : lKey > rKey;
+            };
+        detail::Probe probe("orderBy");
+        probe.engine("std::sort");
+        std::sort(super::m_begin, super::m_end, sortFunc);
+        probe.rowsIn(size_t(std::distance(super::m_begin, super::m_end)));
+        probe.rowsOut(size_t(std::distance(super::m_begin, super::m_end)));
+        return *this;
+    }
+
+    using super::select;
+
+    template <typename SelectFunc>
+    auto select(SelectFunc selectFunc)
+    {
+        using T = ElementType<IterType>;
+        using ReturnType = typename std::decay<decltype(selectFunc(std::declval<const T&>()))>::type;
+        detail::Probe probe("select");
+        std::vector<ReturnType> result;
+        result.reserve(super::expectedRows());
+        super::scan(probe, super::m_takeCount, [&](const auto& ele) { result.push_back(selectFunc(ele)); });
+        probe.output(result.capacity() * sizeof(ReturnType));
+        return result;
+    }
+
+private:
+    std::shared_ptr<const void> m_source;
 };
 
-template <typename T1, typename T2, typename T3, typename WhereCondition>
-class CppLinq<T1, T2, T3, WhereCondition> : public Base<
-        IteratorType<Data<T1, T2, T3>>,
-        CppLinq<T1, T2, T3, WhereCondition>,
-        WhereCondition>
+// A join that has not run yet. Conditions that read only one side are applied
+// to that input before the join, other conditions and skip() to each match as
+// it is found, and take() or first() stop the join once enough rows exist.
+// Any other clause runs the join first and continues on its rows.
+template <typename Left, typename IterType2, typename Algorithm, typename LeftFilter, typename RightFilter,
+    typename Residual, bool Skipped>
+class JoinLinq
+{
+    using Row = ElementType<decltype(std::declval<Left&>().begin())>;
+    using T = ElementType<IterType2>;
+    using NewRow = decltype(detail::append(std::declval<const Row&>(), std::declval<const T&>()));
+    using Result = decltype(detail::makeLinq(std::declval<detail::Vector<NewRow>&>()));
+
+    static constexpr size_t arity = detail::Arity<Row>::value;
+    static constexpr unsigned leftInputs = (1u << arity) - 1;
+    static constexpr unsigned rightInput = 1u << arity;
+
+public:
+    JoinLinq(Left&& left, IterType2 begin2, IterType2 end2, Algorithm algorithm, LeftFilter leftFilter,
+        RightFilter rightFilter, Residual residual, size_t skipCount = 0, size_t takeCount = SIZE_MAX)
+        : m_left(std::move(left)), m_begin2(begin2), m_end2(end2), m_algorithm(algorithm),
+          m_leftFilter(leftFilter), m_rightFilter(rightFilter), m_residual(residual), m_skipCount(skipCount),
+          m_takeCount(takeCount)
+    {
+    }
+
+    // Once rows are skipped or taken, a condition no longer commutes with the
+    // limit and runs on the rows of the join instead.
+    template <typename Condition>
+    auto where(Condition condition)
+    {
+        constexpr unsigned inputs = detail::InputsOf<Condition>::value;
+        if constexpr (Skipped)
+            return materialize().where(condition);
+        else if constexpr ((inputs & ~leftInputs) == 0)
+            return whereLeft(condition);
+        else if constexpr (inputs == rightInput && Algorithm::rightPushdown)
+            return whereRight(detail::AtInput<arity + 1, Condition>{ condition });
+        else
+            return rebind<false>(m_leftFilter, m_rightFilter, detail::both(m_residual, condition));
+    }
+
+    template <typename Condition>
+    auto whereLeft(Condition condition)
+    {
+        if constexpr (Skipped)
+            return materialize().where(detail::Leading<arity, Condition>{ condition });
+        else
+            return rebind<false>(detail::both(m_leftFilter, condition), m_rightFilter, m_residual);
+    }
+
+    template <typename Condition>
+    auto whereRight(Condition condition)
+    {
+        if constexpr (Skipped)
+            return materialize().where(detail::Trailing<Condition>{ condition });
+        else if constexpr (!Algorithm::rightPushdown)
+            return rebind<false>(m_leftFilter, m_rightFilter, detail::both(m_residual, detail::Trailing<Condition>{ condition }));
+        else
+            return rebind<false>(m_leftFilter, detail::both(m_rightFilter, condition), m_residual);
+    }
+
+    auto skip(size_t count)
+    {
+        return rebind<true>(m_leftFilter, m_rightFilter, m_residual, count, m_takeCount);
+    }
+
+    // Like skip, the limit is kept until the join runs, so a later skip still
+    // applies before it.
+    auto take(size_t count)
+    {
+        return rebind<true>(m_leftFilter, m_rightFilter, m_residual, m_skipCount, count);
+    }
+
+    auto first()
+    {
+        if (m_result)
+            return m_result->first();
+        return produce(std::min<size_t>(m_takeCount, 1)).first();
+    }
+
+    bool any()
+    {
+        if (m_result)
+            return m_result->any();
+        bool found = false;
+        run(std::min<size_t>(m_takeCount, 1), [&](const Row&, const T&) { found = true; });
+        return found;
+    }
+
+    size_t count()
+    {
+        if (m_result)
+            return m_result->count();
+        size_t count = 0;
+        run(m_takeCount, [&](const Row&, const T&) { count++; });
+        return count;
+    }
+
+    // Projects every match as it is found, so the joined rows are never built.
+    template <typename SelectFunc>
+    auto select(SelectFunc selectFunc)
+    {
+        using ReturnType = typename std::decay<decltype(detail::call(selectFunc, std::declval<const Row&>(), std::declval<const T&>()))>::type;
+        if (m_result)
+            return m_result->select(selectFunc);
+        detail::Probe probe("select");
+        probe.engine("fused into join");
+        std::vector<ReturnType> result;
+        run(m_takeCount, [&](const Row& l, const T& r) { result.push_back(detail::call(selectFunc, l, r)); });
+        probe.rowsIn(result.size());
+        probe.rowsOut(result.size());
+        probe.output(result.capacity() * sizeof(ReturnType));
+        return result;
+    }
+
+    template <typename Class, typename Member>
+    auto select(Member Class::*member)
+    {
+        return select(detail::Projection<Member Class::*>{ { member } });
+    }
+
+    template <typename First, typename Second, typename... Rest>
+    auto select(First first, Second second, Rest... rest)
+    {
+        return select(detail::Projection<First, Second, Rest...>{ { first, second, rest... } });
+    }
+
+    template <typename Terminal>
+    auto runAsync(Terminal terminal, CancellationToken token = CancellationToken(),
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max())
+    {
+        return detail::runAsync(std::move(*this), terminal, token, deadline);
+    }
+
+    std::string explain()
+    {
+        if (m_result)
+            return m_result->explain();
+        std::string plan = m_left.explain();
+        if (!std::is_same<LeftFilter, detail::Always>::value)
+            plan += "where: pushed below the join into its left input\n";
+        if (!std::is_same<RightFilter, detail::Always>::value)
+            plan += "where: pushed below the join into its right input\n";
+        plan += std::string("join: ") + m_algorithm.name + "\n";
+        if (!std::is_same<Residual, detail::Always>::value)
+            plan += "where: checked on each match\n";
+        if (m_skipCount != 0)
+            plan += "skip: " + std::to_string(m_skipCount) + ", applied to matches as they are found\n";
+        if (m_takeCount != SIZE_MAX)
+            plan += "take: " + std::to_string(m_takeCount) + ", stops the join once enough matches are found\n";
+        return plan;
+    }
+
+#ifdef CPPLINQ_PROFILE
+    template <typename Terminal>
+    auto analyze(Terminal terminal)
+    {
+        return detail::analyze(*this, terminal);
+    }
+#endif
+
+    template <typename... Args> decltype(auto) orderBy(Args&&... args) { return materialize().orderBy(std::forward<Args>(args)...); }
+    template <typename... Args> decltype(auto) join(Args&&... args) { return materialize().join(std::forward<Args>(args)...); }
+    template <typename... Args> decltype(auto) hashJoin(Args&&... args) { return materialize().hashJoin(std::forward<Args>(args)...); }
+    template <typename... Args> decltype(auto) rangeJoin(Args&&... args) { return materialize().rangeJoin(std::forward<Args>(args)...); }
+    template <typename... Args> decltype(auto) asofJoin(Args&&... args) { return materialize().asofJoin(std::forward<Args>(args)...); }
+    template <typename... Args> decltype(auto) groupBy(Args&&... args) { return materialize().groupBy(std::forward<Args>(args)...); }
+    template <typename... Args> decltype(auto) bloomFilter(Args&&... args) { return materialize().bloomFilter(std::forward<Args>(args)...); }
+    template <typename... Args> decltype(auto) parallel(Args&&... args) { return materialize().parallel(std::forward<Args>(args)...); }
+    decltype(auto) last() { return materialize().last(); }
+    decltype(auto) elementAt(size_t index) { return materialize().elementAt(index); }
+    decltype(auto) sum() { return materialize().sum(); }
+    decltype(auto) average() { return materialize().average(); }
+    decltype(auto) begin() { return materialize().begin(); }
+    decltype(auto) end() { return materialize().end(); }
+
+private:
+    template <bool NewSkipped, typename NewLeftFilter, typename NewRightFilter, typename NewResidual>
+    auto rebind(NewLeftFilter leftFilter, NewRightFilter rightFilter, NewResidual residual)
+    {
+        return rebind<NewSkipped>(leftFilter, rightFilter, residual, m_skipCount, m_takeCount);
+    }
+
+    template <bool NewSkipped, typename NewLeftFilter, typename NewRightFilter, typename NewResidual>
+    auto rebind(NewLeftFilter leftFilter, NewRightFilter rightFilter, NewResidual residual, size_t skipCount,
+        size_t takeCount)
+    {
+        return JoinLinq<Left, IterType2, Algorithm, NewLeftFilter, NewRightFilter, NewResidual, NewSkipped>(
+            std::move(m_left), m_begin2, m_end2, m_algorithm, leftFilter, rightFilter, residual, skipCount, takeCount);
+    }
+
+    // Runs the join and calls consume for at most take matches after the
+    // skipped ones; the join algorithm stops as soon as the sink is satisfied.
+    template <typename Consumer>
+    void run(size_t take, Consumer consume)
+    {
+        if (take == 0)
+            return;
+
+        detail::Probe probe("join");
+        probe.engine(m_algorithm.name);
+        detail::Vector<Row> leftCopies;
+        detail::Vector<const Row*> left;
+        size_t leftRows = m_left.takeCount();
+        for (const auto& ele : m_left)
+        {
+            if (leftRows-- == 0)
+                break;
+            if (!detail::call(m_leftFilter, ele))
+                continue;
+            if constexpr (detail::IsForward<decltype(m_left.begin())>::value)
+                left.push_back(&ele);
+            else
+                leftCopies.push_back(ele);
+        }
+        for (const auto& ele : leftCopies)
+        {
+            left.push_back(&ele);
+        }
+        detail::Vector<T> rightCopies;
+        detail::Vector<const T*> right;
+        for (IterType2 it = m_begin2; it != m_end2; ++it)
+        {
+            if (!m_rightFilter(*it))
+                continue;
+            if constexpr (detail::IsForward<IterType2>::value)
+                right.push_back(&*it);
+            else
+                rightCopies.push_back(*it);
+        }
+        for (const auto& ele : rightCopies)
+        {
+            right.push_back(&ele);
+        }
+        probe.rowsIn(left.size() + right.size());
+        size_t rowsOut = 0;
+        size_t skip = m_skipCount;
+        auto sink = [&](size_t i, size_t j) -> bool {
+            if (!detail::call(m_residual, *left[i], *right[j]))
+                return true;
+            if (skip != 0)
+            {
+                skip--;
+                return true;
+            }
+            consume(*left[i], *right[j]);
+            rowsOut++;
+            return --take != 0;
+        };
+        m_algorithm(left, right, sink);
+        probe.rowsOut(rowsOut);
+    }
+
+    Result produce(size_t take)
+    {
+        detail::Vector<NewRow> rows;
+        run(take, [&](const Row& l, const T& r) { rows.push_back(detail::append(l, r)); });
+        detail::Probe probe("materialize");
+        probe.rowsIn(rows.size());
+        probe.rowsOut(rows.size());
+        return detail::makeLinq(rows);
+    }
+
+    Result& materialize()
+    {
+        if (!m_result)
+            m_result.emplace(produce(m_takeCount));
+        return *m_result;
+    }
+
+    Left m_left;
+    IterType2 m_begin2;
+    IterType2 m_end2;
+    Algorithm m_algorithm;
+    LeftFilter m_leftFilter;
+    RightFilter m_rightFilter;
+    Residual m_residual;
+    size_t m_skipCount;
+    size_t m_takeCount;
+    std::optional<Result> m_result;
+};
+
+// Struct-of-arrays table: every field lives in its own contiguous column, so
+// a scan only pulls the columns its predicate or projection reads into cache.
+template <typename... Types>
+class ColumnTable
+{
+public:
+    void addRow(const Types&... values)
+    {
+        addRow(std::index_sequence_for<Types...>(), values...);
+    }
+
+    void reserve(size_t count)
+    {
+        std::apply([count](auto&... columns) { (columns.reserve(count), ...); }, m_columns);
+    }
+
+    size_t size() const
+    {
+        return std::get<0>(m_columns).size();
+    }
+
+    template <size_t I>
+    const auto& column() const
+    {
+        return std::get<I>(m_columns);
+    }
+
+    template <typename Func>
+    decltype(auto) apply(Func& func, size_t row) const
+    {
+        return apply(func, row, std::index_sequence_for<Types...>());
+    }
+
+private:
+    template <size_t... Is>
+    void addRow(std::index_sequence<Is...>, const Types&... values)
+    {
+        (std::get<Is>(m_columns).push_back(values), ...);
+    }
+
+    template <typename Func, size_t... Is>
+    decltype(auto) apply(Func& func, size_t row, std::index_sequence<Is...>) const
+    {
+        return func(std::get<Is>(m_columns)[row]...);
+    }
+
+    std::tuple<std::vector<Types>...> m_columns;
+};
+
+template <typename IterType, typename... Members>
+auto toColumns(IterType begin, IterType end, Members... members)
+{
+    ColumnTable<typename std::decay<decltype(std::declval<const ElementType<IterType>&>().*members)>::type...> table;
+    for (IterType it = begin; it != end; ++it)
+    {
+        table.addRow((*it).*members...);
+    }
+    return table;
+}
+
+// Query over a ColumnTable. Conditions, keys and projections receive one
+// argument per column, like the Data stages do; where() narrows a selection
+// vector of row ids, so the columns themselves are never copied.
+template <typename Table>
+class ColumnLinq
+{
+public:
+    ColumnLinq(const Table& table) : m_table(&table) {}
+
+    template <typename Condition>
+    auto& where(Condition condition)
+    {
+        detail::Vector<size_t> selection(m_all ? m_table->size() : m_selection.size());
+        size_t count = 0;
+        if (m_all)
+        {
+            for (size_t row = 0; row < selection.size(); row++)
+            {
+                selection[count] = row;
+                count += m_table->apply(condition, row) ? 1 : 0;
+            }
+        }
+        else
+        {
+            for (size_t row : m_selection)
+            {
+                selection[count] = row;
+                count += m_table->apply(condition, row) ? 1 : 0;
+            }
+        }
+        selection.resize(count);
+        m_selection.swap(selection);
+        m_all = false;
+        return *this;
+    }
+
+    template <typename GetOrderKey>
+    auto& orderBy(GetOrderKey getOrderKey, Order order = Order::Ascend)
+    {
+        using Key = typename std::decay<decltype(m_table->apply(getOrderKey, 0))>::type;
+        detail::Vector<std::pair<Key, size_t>> keys;
+        forEach(0, SIZE_MAX, [&](size_t row) { keys.push_back({ m_table->apply(getOrderKey, row), row }); });
+        std::sort(keys.begin(), keys.end(), [order](const auto& l, const auto& r) {
+                return order == Order::Ascend ? l.first < r.first : l.first > r.first;
+            });
+        m_selection.resize(keys.size());
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            m_selection[i] = keys[i].second;
+        }
+        m_all = false;
+        return *this;
+    }
+
+    template <typename SelectFunc>
+    auto select(SelectFunc selectFunc)
+    {
+        using ReturnType = typename std::decay<decltype(m_table->apply(selectFunc, 0))>::type;
+        std::vector<ReturnType> result;
+        result.reserve(count());
+        forEach(m_skipCount, m_takeCount, [&](size_t row) { result.push_back(m_table->apply(selectFunc, row)); });
+        return result;
+    }
+
+    size_t count()
+    {
+        size_t total = m_all ? m_table->size() : m_selection.size();
+        return total <= m_skipCount ? 0 : std::min(total - m_skipCount, m_takeCount);
+    }
+
+    auto& take(size_t count)
+    {
+        m_takeCount = count;
+        return *this;
+    }
+
+    auto& skip(size_t count)
+    {
+        m_skipCount = count;
+        return *this;
+    }
+
+    const detail::Vector<size_t>& selection()
+    {
+        if (m_all)
+        {
+            m_selection.resize(m_table->size());
+            for (size_t row = 0; row < m_selection.size(); row++)
+            {
+                m_selection[row] = row;
+            }
+            m_all = false;
+        }
+        return m_selection;
+    }
+
+private:
+    template <typename Func>
+    void forEach(size_t skip, size_t take, Func func)
+    {
+        size_t total = m_all ? m_table->size() : m_selection.size();
+        size_t end = total - std::min(total, skip) < take ? total : skip + take;
+        for (size_t i = skip; i < end; i++)
+        {
+            func(m_all ? i : m_selection[i]);
+        }
+    }
+
+    const Table* m_table;
+    detail::Vector<size_t> m_selection;
+    bool m_all = true;
+    size_t m_takeCount = SIZE_MAX;
+    size_t m_skipCount = 0;
+};
+
+template <typename... Types>
+auto fromColumns(const ColumnTable<Types...>& table)
+{
+    return ColumnLinq<ColumnTable<Types...>>(table);
+}
+
+template <typename IterType>
+auto from(IterType begin, IterType end)
+{
+    return CppLinq<IterType, DefaultCondition<ElementType<IterType>>>(begin, end);
+}
+
+// Read-only mapping of a file of fixed-size records. Pages are faulted in by
+// the scan itself, so there is no load phase and no copy; a trailing partial
+// record is ignored.
+template <typename T>
+class MappedFile
 {
-    using super = Base<
-        IteratorType<Data<T1, T2, T3>>,
-        CppLinq<T1, T2, T3, WhereCondition>,
-        WhereCondition>;
-private:
-    std::vector<Data<T1, T2, T3>> m_data;
+    static_assert(std::is_trivially_copyable<T>::value, "mapped records must be trivially copyable");
+
 public:
-    CppLinq() : super([](const auto&){return true;})
+    explicit MappedFile(const std::string& path)
     {
-        super::m_begin = m_data.begin();
-        super::m_end = m_data.end();
+#ifdef _WIN32
+        m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        LARGE_INTEGER size;
+        if (m_file == INVALID_HANDLE_VALUE || !GetFileSizeEx(m_file, &size))
+        {
+            close();
+            throw std::runtime_error("cpplinq: cannot open " + path);
+        }
+        m_bytes = size_t(size.QuadPart);
+        if (m_bytes != 0)
+        {
+            m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            m_address = m_mapping == nullptr ? nullptr : MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+#else
+        m_file = ::open(path.c_str(), O_RDONLY);
+        struct stat info;
+        if (m_file < 0 || fstat(m_file, &info) != 0)
+        {
+            close();
+            throw std::runtime_error("cpplinq: cannot open " + path);
+        }
+        m_bytes = size_t(info.st_size);
+        if (m_bytes != 0)
+        {
+            m_address = mmap(nullptr, m_bytes, PROT_READ, MAP_PRIVATE, m_file, 0);
+            if (m_address == MAP_FAILED)
+                m_address = nullptr;
+            else
+            {
+                madvise(m_address, m_bytes, MADV_SEQUENTIAL);
+                madvise(m_address, m_bytes, MADV_WILLNEED);
+            }
+        }
+#endif
+        if (m_bytes != 0 && m_address == nullptr)
+        {
+            close();
+            throw std::runtime_error("cpplinq: cannot map " + path);
+        }
     }
 
-    CppLinq(std::vector<Data<T1, T2, T3>>& v, WhereCondition condition) : super(condition)
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
     {
-        std::swap(m_data, v);
-        super::m_begin = m_data.begin();
-        super::m_end = m_data.end();
+        close();
     }
 
-    void addData(const Data<T1, T2, T3>& v)
+    const T* begin() const
     {
-        m_data.push_back(v);
-        super::m_begin = m_data.begin();
-        super::m_end = m_data.end();
+        return static_cast<const T*>(m_address);
     }
 
-    template <typename IterType, typename Condition>
-    auto join(IterType begin, IterType end, Condition condition)
+    const T* end() const
     {
-        using T4 = ElementType<IterType>;
-        using NewType = CppLinq<T1, T2, T3, T4> ;
-        NewType result;
-        for (const auto& ele : *this)
-        {
-            for (IterType it = begin; it != end; it++)
-            {
-                const T4& ele4 = *it;
-                if (condition(ele.var1, ele.var2, ele.var3, ele4))
-                {
-                    result.addData({ ele.var1, ele.var2, ele.var3, ele4 });
-                }
-            }
-        }
-        return result;
+        return begin() + size();
     }
 
-    template <typename Condition2>
-    auto where(Condition2 condition)
+    size_t size() const
     {
-        auto cond = [&](const auto& o) -> bool { return condition(o.var1, o.var2, o.var3); };
-        CppLinq<T1, T2, T3, decltype(cond)> linq(m_data, cond);
-        return linq;
+        return m_bytes / sizeof(T);
     }
 
-    template <typename GetOrderKey>    
-    auto& orderBy(GetOrderKey getOrderKey, Order order = Order::Ascend)
+    const T& operator[](size_t index) const
     {
-        auto sortFunc = [&](const auto& l, const auto& r){ 
-                auto lKey = getOrderKey(l.var1, l.var2, l.var3);
-                auto rKey = getOrderKey(r.var1, r.var2, r.var3);
-                return order == Order::Ascend ? lKey < rKey : lKey > rKey;
-            };
-        std::sort(super::m_begin, super::m_end, sortFunc);
+        return begin()[index];
+    }
+
+private:
+    void close()
+    {
+#ifdef _WIN32
+        if (m_address != nullptr)
+            UnmapViewOfFile(m_address);
+        if (m_mapping != nullptr)
+            CloseHandle(m_mapping);
+        if (m_file != INVALID_HANDLE_VALUE)
+            CloseHandle(m_file);
+#else
+        if (m_address != nullptr)
+            munmap(m_address, m_bytes);
+        if (m_file >= 0)
+            ::close(m_file);
+#endif
+    }
+
+#ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#else
+    int m_file = -1;
+#endif
+    void* m_address = nullptr;
+    size_t m_bytes = 0;
+};
+
+// Queries a file of T records in place; the mapping stays open for as long as
+// the query or any later stage of it exists.
+template <typename T>
+auto fromMappedFile(const std::string& path)
+{
+    auto file = std::make_shared<const MappedFile<T>>(path);
+    return CppLinq<const T*, DefaultCondition<T>>(file->begin(), file->end(), DefaultCondition<T>(), file);
+}
+
+// Single-pass input iterator over a source that produces one element per
+// next() call and exposes it through current() until the following call. The
+// first element is pulled when the iterator is first used, not when it is
+// built, so a query that never runs reads nothing.
+template <typename Source>
+class PullIterator
+{
+public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = typename std::decay<decltype(std::declval<const Source&>().current())>::type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const value_type*;
+    using reference = const value_type&;
+
+    PullIterator() = default;
+
+    explicit PullIterator(Source* source) : m_source(source), m_pending(true) {}
+
+    const value_type& operator*() const
+    {
+        pull();
+        return m_source->current();
+    }
+
+    PullIterator& operator++()
+    {
+        pull();
+        if (!m_source->next())
+            m_source = nullptr;
         return *this;
     }
 
-    template <typename SelectFunc>
-    auto select(SelectFunc selectFunc)
+    PullIterator operator++(int)
     {
-        using ReturnType = decltype(selectFunc(std::declval<const T1&>(), std::declval<const T2&>(), std::declval<const T3&>()));
-        std::vector<ReturnType> result;
-        size_t count = super::m_takeCount;
-        for (const auto& ele : *this)
+        PullIterator it(*this);
+        ++*this;
+        return it;
+    }
+
+    bool operator==(const PullIterator& r) const
+    {
+        pull();
+        r.pull();
+        return m_source == r.m_source;
+    }
+
+    bool operator!=(const PullIterator& r) const
+    {
+        return !(*this == r);
+    }
+
+private:
+    void pull() const
+    {
+        if (m_pending)
         {
-            if (count--)
-                result.push_back(selectFunc(ele.var1, ele.var2, ele.var3));
-            else
-                break;
+            m_pending = false;
+            if (!m_source->next())
+                m_source = nullptr;
         }
-        return result;
     }
+
+    mutable Source* m_source = nullptr;
+    mutable bool m_pending = false;
 };
 
-template <typename T1, typename T2>
-struct Data<T1, T2>
+// Queries any source with next() and current(); the query keeps it alive.
+template <typename Source>
+auto fromSource(std::shared_ptr<Source> source)
 {
-    T1 var1;
-    T2 var2;
+    using T = typename PullIterator<Source>::value_type;
+    PullIterator<Source> begin(source.get());
+    return CppLinq<PullIterator<Source>, DefaultCondition<T>>(begin, PullIterator<Source>(), DefaultCondition<T>(), source);
+}
+
+template <typename... Types>
+struct CsvSchema
+{
+    char delimiter = ',';
+    bool header = true;
 };
-    
-template <typename T1, typename T2, typename WhereCondition>
-class CppLinq<T1, T2, WhereCondition> 
-    : public Base<
-        IteratorType<Data<T1, T2>>,
-        CppLinq<T1, T2, WhereCondition>,
-        WhereCondition>
+
+// One line of a CSV file, split on the delimiter. Fields are views into the
+// reader's buffer and stay valid until the scan moves on; zen::get<I>() parses
+// a numeric field only when it is read and throws std::runtime_error naming
+// the line and column when it is not a number. Quoted fields are not supported.
+template <typename... Types>
+class CsvRow
 {
-    using super = Base<
-        IteratorType<Data<T1, T2>>,
-        CppLinq<T1, T2, WhereCondition>,
-        WhereCondition>;
-private:
-    std::vector<Data<T1, T2>> m_data;
 public:
-    CppLinq() : super([](const auto&){return true;})
+    static constexpr size_t columns = sizeof...(Types);
+
+    void assign(const char* line, size_t length, char delimiter, size_t lineNumber)
     {
-        super::m_begin = m_data.begin();
-        super::m_end = m_data.end();
+        m_line = line;
+        m_lineNumber = lineNumber;
+        size_t pos = 0;
+        for (size_t i = 0; i < columns; i++)
+        {
+            const char* found = pos < length ? static_cast<const char*>(std::memchr(line + pos, delimiter, length - pos)) : nullptr;
+            const size_t end = found == nullptr ? length : size_t(found - line);
+            m_starts[i] = std::min(pos, length);
+            m_ends[i] = end;
+            pos = end + 1;
+        }
     }
 
-    CppLinq(std::vector<Data<T1, T2>>& v, WhereCondition condition) : super(condition)
+    std::string_view field(size_t index) const
     {
-        std::swap(m_data, v);
-        super::m_begin = m_data.begin();
-        super::m_end = m_data.end();
+        return std::string_view(m_line + m_starts[index], m_ends[index] - m_starts[index]);
+    }
+
+    // 1-based line number in the file, counting the header and empty lines.
+    size_t lineNumber() const
+    {
+        return m_lineNumber;
     }
 
-    CppLinq(IteratorType<Data<T1, T2>> begin, IteratorType<Data<T1, T2>> end, WhereCondition condition) : super(begin, end, condition) {}
+private:
+    const char* m_line = nullptr;
+    size_t m_lineNumber = 0;
+    std::array<size_t, columns> m_starts = {};
+    std::array<size_t, columns> m_ends = {};
+};
 
-    void addData(const Data<T1, T2>& v)
+template <size_t I, typename... Types>
+auto get(const CsvRow<Types...>& row)
+{
+    using T = typename std::tuple_element<I, std::tuple<Types...>>::type;
+    std::string_view text = row.field(I);
+    if constexpr (std::is_same<T, std::string_view>::value)
+        return text;
+    else if constexpr (std::is_same<T, std::string>::value)
+        return std::string(text);
+    else
     {
-        m_data.push_back(v);
-        super::m_begin = m_data.begin();
-        super::m_end = m_data.end();
+        static_assert(std::is_arithmetic<T>::value, "CSV columns are numbers, std::string or std::string_view");
+        T value = T();
+        const char* end = text.data() + text.size();
+        auto [ptr, ec] = std::from_chars(text.data(), end, value);
+        if (ec != std::errc() || ptr != end)
+            throw std::runtime_error("cpplinq: cannot parse \"" + std::string(text) + "\" at line "
+                + std::to_string(row.lineNumber()) + ", column " + std::to_string(I + 1));
+        return value;
     }
-    
-    template <typename IterType, typename Condition>
-    auto join(IterType begin, IterType end, Condition condition)
+}
+
+// Reads a CSV file in CPPLINQ_CSV_CHUNK_BYTES chunks and hands out one line at
+// a time. Line ends are found with memchr, which the C library vectorizes.
+template <typename... Types>
+class CsvReader
+{
+public:
+    CsvReader(const std::string& path, CsvSchema<Types...> schema)
+        : m_schema(schema), m_buffer(CPPLINQ_CSV_CHUNK_BYTES)
     {
-        using T3 = ElementType<IterType>;
-        CppLinq<T1, T2, T3, DefaultCondition<Data<T1, T2, T3>>> result;
-        for (const auto& ele : *this)
+        m_file = std::fopen(path.c_str(), "rb");
+        if (m_file == nullptr)
+            throw std::runtime_error("cpplinq: cannot open " + path);
+        m_skipHeader = m_schema.header;
+    }
+
+    CsvReader(const CsvReader&) = delete;
+    CsvReader& operator=(const CsvReader&) = delete;
+
+    ~CsvReader()
+    {
+        std::fclose(m_file);
+    }
+
+    // Moves to the next non-empty line; returns false at the end of the file.
+    // The header is skipped on the first call, so nothing is read until the
+    // query runs.
+    bool next()
+    {
+        if (m_skipHeader)
+        {
+            m_skipHeader = false;
+            if (!next())
+                return false;
+        }
+        for (;;)
         {
-            for (auto it = begin; it != end; it++)
+            const char* begin = m_buffer.data() + m_pos;
+            const char* newline = static_cast<const char*>(std::memchr(begin, '\n', m_filled - m_pos));
+            if (newline == nullptr && !m_eof)
             {
-                const T3& ele3 = *it;
-                if (condition(ele.var1, ele.var2, ele3))
-                {
-                    result.addData({ ele.var1, ele.var2, ele3 });
-                }
+                refill();
+                continue;
+            }
+
+            size_t length = newline == nullptr ? m_filled - m_pos : size_t(newline - begin);
+            if (newline == nullptr && length == 0)
+                return false;
+            m_pos += newline == nullptr ? length : length + 1;
+            m_lineNumber++;
+            if (length != 0 && begin[length - 1] == '\r')
+                length--;
+            if (length != 0)
+            {
+                m_row.assign(begin, length, m_schema.delimiter, m_lineNumber);
+                return true;
             }
         }
-        return result;
     }
 
-    template <typename Condition2>
-    auto where(Condition2 condition)
+    const CsvRow<Types...>& current() const
     {
-        auto cond = [&](const auto& o) -> bool { return condition(o.var1, o.var2); };
-        CppLinq<T1, T2, decltype(cond)> linq(m_data, cond);
-        return linq;
+        return m_row;
     }
 
-    template <typename GetOrderKey>    
-    auto& orderBy(GetOrderKey getOrderKey, Order order = Order::Ascend)
+private:
+    void refill()
     {
-        auto sortFunc = [&](const auto& l, const auto& r){ 
-                auto lKey = getOrderKey(l.var1, l.var2);
-                auto rKey = getOrderKey(r.var1, r.var2);
-                return order == Order::Ascend ? lKey < rKey : lKey > rKey;
-            };
-        std::sort(super::m_begin, super::m_end, sortFunc);
-        return *this;
+        const size_t rest = m_filled - m_pos;
+        std::memmove(m_buffer.data(), m_buffer.data() + m_pos, rest);
+        if (rest == m_buffer.size())
+            m_buffer.resize(m_buffer.size() * 2);
+        const size_t wanted = m_buffer.size() - rest;
+        const size_t read = std::fread(m_buffer.data() + rest, 1, wanted, m_file);
+        m_filled = rest + read;
+        m_pos = 0;
+        m_eof = read < wanted;
     }
 
-    template <typename SelectFunc>
-    auto select(SelectFunc selectFunc)
+    CsvSchema<Types...> m_schema;
+    std::FILE* m_file = nullptr;
+    detail::Vector<char> m_buffer;
+    size_t m_pos = 0;
+    size_t m_filled = 0;
+    size_t m_lineNumber = 0;
+    bool m_eof = false;
+    bool m_skipHeader = false;
+    CsvRow<Types...> m_row;
+};
+
+// Streams a CSV file through a query without loading it. The scan is single
+// pass and rows are not kept, so select() the fields a join or orderBy needs.
+template <typename... Types>
+auto fromCsv(const std::string& path, CsvSchema<Types...> schema = CsvSchema<Types...>())
+{
+    return fromSource(std::make_shared<CsvReader<Types...>>(path, schema));
+}
+
+template <typename Func>
+class GeneratorSource
+{
+    using T = typename std::decay<decltype(*std::declval<Func&>()())>::type;
+
+public:
+    explicit GeneratorSource(Func func) : m_func(std::move(func)) {}
+
+    bool next()
     {
-        using ReturnType = decltype(selectFunc(std::declval<const T1&>(), std::declval<const T2&>()));
-        std::vector<ReturnType> result;
-        size_t count = super::m_takeCount;
-        for (const auto& ele : *this)
-        {
-            if (count--)
-                result.push_back(selectFunc(ele.var1, ele.var2));
-            else
-                break;
-        }
-        return result;
+        m_value = m_func();
+        return m_value.has_value();
     }
-    
+
+    const T& current() const
+    {
+        return *m_value;
+    }
+
+private:
+    Func m_func;
+    std::optional<T> m_value;
 };
 
-template <typename IterType, typename WhereCondition>
-class CppLinq<IterType, WhereCondition> : public Base<IterType, CppLinq<IterType, WhereCondition>, WhereCondition>
+// Queries the values func returns, one call per element, until it returns an
+// empty std::optional. Nothing is buffered, so take(), first() and any() stop
+// an unbounded generator as soon as they have their answer.
+template <typename Func>
+auto fromGenerator(Func func)
+{
+    return fromSource(std::make_shared<GeneratorSource<Func>>(std::move(func)));
+}
+
+#ifdef CPPLINQ_HAS_COROUTINES
+// Coroutine that co_yields the elements of a query on demand.
+template <typename T>
+class Generator
 {
-    using super = Base<IterType, CppLinq<IterType, WhereCondition>, WhereCondition>;
 public:
-    CppLinq(IterType begin, IterType end) : super(begin, end) {}
-    CppLinq(IterType begin, IterType end, WhereCondition condition) : super(begin, end, condition) {}
-    
-    template <typename IterType2, typename JoinCondition>
-    auto join(IterType2 begin2, IterType2 end2, JoinCondition condition)
+    struct promise_type
     {
-        using T1 = ElementType<IterType>;
-        using T2 = ElementType<IterType2>;
-        CppLinq<T1, T2, DefaultCondition<Data<T1, T2>>> result;
-        for (IterType it1 = super::m_begin; it1 != super::m_end; ++it1)
+        const T* value = nullptr;
+        std::exception_ptr error;
+
+        Generator get_return_object()
         {
-            const T1& ele = *it1;
-            for (IterType2 it2 = begin2; it2 != end2; ++it2)
-            {
-                const T2& ele2 = *it2;
-                if (condition(ele, ele2))
-                {
-                    result.addData({ ele, ele2 });
-                }
-            }
+            return Generator(std::coroutine_handle<promise_type>::from_promise(*this));
         }
-        return result;
-    }
 
-    template <typename WhereCondition2>
-    CppLinq<IterType, WhereCondition2> where(WhereCondition2 condition)
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_always final_suspend() noexcept { return {}; }
+
+        std::suspend_always yield_value(const T& v) noexcept
+        {
+            value = std::addressof(v);
+            return {};
+        }
+
+        void return_void() noexcept {}
+
+        void unhandled_exception()
+        {
+            error = std::current_exception();
+        }
+    };
+
+    explicit Generator(std::coroutine_handle<promise_type> handle) : m_handle(handle) {}
+
+    Generator(Generator&& other) noexcept : m_handle(std::exchange(other.m_handle, nullptr)) {}
+
+    Generator(const Generator&) = delete;
+    Generator& operator=(const Generator&) = delete;
+
+    ~Generator()
     {
-        CppLinq<IterType, WhereCondition2> linq(super::m_begin, super::m_end, condition); 
-        return linq;
+        if (m_handle)
+            m_handle.destroy();
     }
 
-    template <typename GetOrderKey>    
-    auto& orderBy(GetOrderKey getOrderKey, Order order = Order::Ascend)
+    bool next()
     {
-        auto sortFunc = [&](const auto& l, const auto& r){ 
-                auto lKey = getOrderKey(l);
-                auto rKey = getOrderKey(r);
-                return order == Order::Ascend ? lKey < rKey : lKey > rKey;
-            };
-        std::sort(super::m_begin, super::m_end, sortFunc);
-        return *this;
+        if (m_handle.done())
+            return false;
+        m_handle.resume();
+        if (m_handle.promise().error)
+            std::rethrow_exception(m_handle.promise().error);
+        return !m_handle.done();
     }
 
-    template <typename SelectFunc>
-    auto select(SelectFunc selectFunc)
+    const T& current() const
     {
-        using T = ElementType<IterType>;
-        using ReturnType = decltype(selectFunc(std::declval<const T&>()));
-        std::vector<ReturnType> result;
-        size_t count = super::m_takeCount;
-        for (const auto& ele : *this)
-        {
-            if (count--)
-                result.push_back(selectFunc(ele));
-            else
-                break;
-        }
-        return result;
+        return *m_handle.promise().value;
     }
+
+private:
+    std::coroutine_handle<promise_type> m_handle;
 };
 
-template <typename IterType>
-auto from(IterType begin, IterType end)
+template <typename T>
+auto fromGenerator(Generator<T> generator)
 {
-    return CppLinq<IterType, DefaultCondition<ElementType<IterType>>>(begin, end);
+    return fromSource(std::make_shared<Generator<T>>(std::move(generator)));
 }
+#endif
 };
 
 #ifdef USE_CPPLINQ_MACRO
 
 #define FROM(o) zen::from(std::begin(o), std::end(o))
+#define FROM_COLUMNS(o) zen::fromColumns(o)
 #define DESCEND zen::Order::Descend
 #define TAKE(count) .take(count)
 #define SKIP(count) .skip(count)
 #define FIRST() .first()
 #define LAST() .last()
+#define ELEMENTAT(index) .elementAt(index)
 #define COUNT() .count()
+#define ANY() .any()
 #define SUM() .sum()
 #define AVERAGE() .average()
+#define PARALLEL(...) .parallel(__VA_ARGS__)
 
 #define WHERE(condition) .where([](const auto& o) -> bool { return condition; })
 #define WHERE2(condition) .where([](const auto& o1, const auto& o2) -> bool { return condition; })
 #define WHERE3(condition) .where([](const auto& o1, const auto& o2, const auto& o3) -> bool { return condition; })
 #define WHERE4(condition) .where([](const auto& o1, const auto& o2, const auto& o3, const auto& o4) -> bool { return condition; })
 
+#define WHERELEFT(condition) .whereLeft([](const auto& o1) -> bool { return condition; })
+#define WHERELEFT2(condition) .whereLeft([](const auto& o1, const auto& o2) -> bool { return condition; })
+#define WHERELEFT3(condition) .whereLeft([](const auto& o1, const auto& o2, const auto& o3) -> bool { return condition; })
+
+#define WHERERIGHT(condition) .whereRight([](const auto& o2) -> bool { return condition; })
+#define WHERERIGHT2(condition) .whereRight([](const auto& o3) -> bool { return condition; })
+#define WHERERIGHT3(condition) .whereRight([](const auto& o4) -> bool { return condition; })
+
 #define SELECT(...) .select([](const auto& o) { return std::make_tuple(__VA_ARGS__); })
 #define SELECT2(...) .select([](const auto& o1, const auto& o2) { return std::make_tuple(__VA_ARGS__); })
 #define SELECT3(...) .select([](const auto& o1, const auto& o2, const auto& o3) { return std::make_tuple(__VA_ARGS__); })
@@ -578,10 +3580,53 @@ auto from(IterType begin, IterType end)
 #define ORDERBY3(key, ...) .orderBy([](const auto& o1, const auto& o2, const auto& o3) { return key; } OPT_ARGS(__VA_ARGS__))
 #define ORDERBY4(key, ...) .orderBy([](const auto& o1, const auto& o2, const auto& o3, const auto& o4) { return key; } OPT_ARGS(__VA_ARGS__))
 
+#define GROUPBY(key, init, update) .groupBy([](const auto& o) { return key; }, init, [](auto& acc, const auto& o) { update; })
+#define GROUPBY2(key, init, update) .groupBy([](const auto& o1, const auto& o2) { return key; }, init, \
+    [](auto& acc, const auto& o1, const auto& o2) { update; })
+#define GROUPBY3(key, init, update) .groupBy([](const auto& o1, const auto& o2, const auto& o3) { return key; }, init, \
+    [](auto& acc, const auto& o1, const auto& o2, const auto& o3) { update; })
+#define GROUPBY4(key, init, update) .groupBy([](const auto& o1, const auto& o2, const auto& o3, const auto& o4) { return key; }, init, \
+    [](auto& acc, const auto& o1, const auto& o2, const auto& o3, const auto& o4) { update; })
+
 #define JOIN(o) .join(std::begin(o), std::end(o), [](const auto& o1, const auto& o2) -> bool
 #define JOIN2(o) .join(std::begin(o), std::end(o), [](const auto& o1, const auto& o2, const auto& o3) -> bool
-#define JOIN3(o) .join(std::begin(o), std::end(o), [](const auto& o1, const auto& o2, const auto& o3, cosnt auto& o4) -> bool
+#define JOIN3(o) .join(std::begin(o), std::end(o), [](const auto& o1, const auto& o2, const auto& o3, const auto& o4) -> bool
 
 #define ON(...)  { return __VA_ARGS__; })
 
+#define BLOOM_FILTER zen::JoinHint::BloomFilter
+#define RADIX_PARTITION zen::JoinHint::RadixPartition
+#define DIRECT_ADDRESS zen::JoinHint::DirectAddress
+
+#define HASHJOIN(o, leftKey, rightKey, ...) .hashJoin(std::begin(o), std::end(o), [](const auto& o1) { return leftKey; }, \
+    [](const auto& o2) { return rightKey; } OPT_ARGS(__VA_ARGS__))
+#define HASHJOIN2(o, leftKey, rightKey, ...) .hashJoin(std::begin(o), std::end(o), [](const auto& o1, const auto& o2) { return leftKey; }, \
+    [](const auto& o3) { return rightKey; } OPT_ARGS(__VA_ARGS__))
+#define HASHJOIN3(o, leftKey, rightKey, ...) .hashJoin(std::begin(o), std::end(o), [](const auto& o1, const auto& o2, const auto& o3) { return leftKey; }, \
+    [](const auto& o4) { return rightKey; } OPT_ARGS(__VA_ARGS__))
+
+#define ASOFJOIN(o, leftTs, rightTs, ...) .asofJoin(std::begin(o), std::end(o), [](const auto& o1) { return leftTs; }, \
+    [](const auto& o2) { return rightTs; } OPT_ARGS(__VA_ARGS__))
+#define ASOFJOIN2(o, leftTs, rightTs, ...) .asofJoin(std::begin(o), std::end(o), [](const auto& o1, const auto& o2) { return leftTs; }, \
+    [](const auto& o3) { return rightTs; } OPT_ARGS(__VA_ARGS__))
+#define ASOFJOIN3(o, leftTs, rightTs, ...) .asofJoin(std::begin(o), std::end(o), [](const auto& o1, const auto& o2, const auto& o3) { return leftTs; }, \
+    [](const auto& o4) { return rightTs; } OPT_ARGS(__VA_ARGS__))
+
+#define ASOFJOINBY(o, leftTs, rightTs, leftBy, rightBy, ...) .asofJoin(std::begin(o), std::end(o), \
+    [](const auto& o1) { return leftTs; }, [](const auto& o2) { return rightTs; }, \
+    [](const auto& o1) { return leftBy; }, [](const auto& o2) { return rightBy; } OPT_ARGS(__VA_ARGS__))
+#define ASOFJOINBY2(o, leftTs, rightTs, leftBy, rightBy, ...) .asofJoin(std::begin(o), std::end(o), \
+    [](const auto& o1, const auto& o2) { return leftTs; }, [](const auto& o3) { return rightTs; }, \
+    [](const auto& o1, const auto& o2) { return leftBy; }, [](const auto& o3) { return rightBy; } OPT_ARGS(__VA_ARGS__))
+#define ASOFJOINBY3(o, leftTs, rightTs, leftBy, rightBy, ...) .asofJoin(std::begin(o), std::end(o), \
+    [](const auto& o1, const auto& o2, const auto& o3) { return leftTs; }, [](const auto& o4) { return rightTs; }, \
+    [](const auto& o1, const auto& o2, const auto& o3) { return leftBy; }, [](const auto& o4) { return rightBy; } OPT_ARGS(__VA_ARGS__))
+
+#define RANGEJOIN(o, key, low, high) .rangeJoin(std::begin(o), std::end(o), [](const auto& o1) { return key; }, \
+    [](const auto& o2) { return low; }, [](const auto& o2) { return high; })
+#define RANGEJOIN2(o, key, low, high) .rangeJoin(std::begin(o), std::end(o), [](const auto& o1, const auto& o2) { return key; }, \
+    [](const auto& o3) { return low; }, [](const auto& o3) { return high; })
+#define RANGEJOIN3(o, key, low, high) .rangeJoin(std::begin(o), std::end(o), [](const auto& o1, const auto& o2, const auto& o3) { return key; }, \
+    [](const auto& o4) { return low; }, [](const auto& o4) { return high; })
+
 #endif
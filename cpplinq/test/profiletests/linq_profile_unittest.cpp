@@ -0,0 +1,132 @@
+#include "gtest/gtest.h"
+
+#define USE_CPPLINQ_MACRO
+#define CPPLINQ_PROFILE
+#include "cpplinq.h"
+
+#include <cstdio>
+#include <string>
+#include <fstream>
+
+TEST(CppLinq, analyze)
+{
+    std::vector<int> numbers;
+    for (int i = 0; i < 10000; i++)
+    {
+        numbers.push_back(i);
+    }
+    int digits[] = { 0, 1, 2 };
+
+    auto analyzed = FROM (numbers)
+        HASHJOIN (digits, o1 % 10, o2)
+        .analyze([](auto& q) { return q ORDERBY2 (o1, DESCEND) TAKE (2) SELECT2 (o1, o2); });
+
+    std::vector<std::tuple<int, int>> expectedResult = { { 9992, 2 }, { 9991, 1 } };
+    EXPECT_EQ(analyzed.first, expectedResult);
+
+    const auto& stages = analyzed.second.stages;
+    ASSERT_EQ(stages.size(), 4u);
+    EXPECT_EQ(stages[0].op, "join");
+    EXPECT_EQ(stages[0].engine, "hash join, direct-address array");
+    EXPECT_EQ(stages[0].rowsIn, 10003u);
+    EXPECT_EQ(stages[0].rowsOut, 3000u);
+    EXPECT_EQ(stages[1].op, "materialize");
+    EXPECT_EQ(stages[2].op, "orderBy");
+    EXPECT_EQ(stages[2].rowsIn, 3000u);
+    EXPECT_EQ(stages[3].op, "select");
+    EXPECT_EQ(stages[3].rowsOut, 2u);
+    EXPECT_NE(analyzed.second.format().find("hash join, direct-address array"), std::string::npos);
+
+    auto fused = FROM (numbers)
+        WHERE (o % 2 == 0)
+        .analyze([](auto& q) { return q COUNT (); });
+    EXPECT_EQ(fused.first, 5000u);
+    ASSERT_EQ(fused.second.stages.size(), 1u);
+    EXPECT_EQ(fused.second.stages[0].engine, "fused scan");
+    EXPECT_EQ(fused.second.stages[0].rowsIn, 10000u);
+
+    auto limited = FROM (numbers)
+        WHERE (o % 2 == 0)
+        SKIP (10)
+        TAKE (100)
+        .analyze([](auto& q) { return q COUNT (); });
+    EXPECT_EQ(limited.first, 100u);
+    ASSERT_EQ(limited.second.stages.size(), 1u);
+    EXPECT_EQ(limited.second.stages[0].engine, "batched scan");
+    EXPECT_GT(limited.second.stages[0].rowsIn, 0u);
+    EXPECT_EQ(limited.second.stages[0].rowsOut, 100u);
+
+    std::vector<int> small = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    auto rowScan = FROM (small)
+        WHERE (o > 2)
+        TAKE (3)
+        .analyze([](auto& q) { return q SUM (); });
+    EXPECT_EQ(rowScan.first, 3 + 4 + 5);
+    ASSERT_EQ(rowScan.second.stages.size(), 1u);
+    EXPECT_EQ(rowScan.second.stages[0].engine, "row scan");
+    EXPECT_EQ(rowScan.second.stages[0].rowsIn, 5u);
+    EXPECT_EQ(rowScan.second.stages[0].rowsOut, 3u);
+}
+
+TEST(CppLinq, allocations)
+{
+    std::vector<int> numbers;
+    for (int i = 0; i < 10000; i++)
+    {
+        numbers.push_back(i);
+    }
+    int digits[] = { 0, 1, 2 };
+
+    auto selected = FROM (numbers)
+        .analyze([](auto& q) { return q SKIP (100) SELECT (o); });
+    EXPECT_EQ(selected.first.size(), 9900u);
+    ASSERT_EQ(selected.second.stages.size(), 1u);
+    EXPECT_EQ(selected.second.stages[0].allocations, 1u);
+    EXPECT_EQ(selected.second.stages[0].bytes, 9900 * sizeof(int));
+    EXPECT_EQ(selected.second.bytes, 9900 * sizeof(int));
+    EXPECT_EQ(selected.second.peakBytes, 9900 * sizeof(int));
+
+    auto joined = FROM (numbers)
+        JOIN (digits) ON (o1 % 10 == o2)
+        .analyze([](auto& q) { return q ORDERBY2 (o1) SELECT2 (o1); });
+    EXPECT_EQ(joined.first.size(), 3000u);
+    const auto& stages = joined.second.stages;
+    ASSERT_EQ(stages.size(), 4u);
+    EXPECT_GT(stages[0].allocations, 0u);
+    EXPECT_GE(stages[0].bytes, 3000 * sizeof(zen::Data<int, int>));
+    EXPECT_GT(stages[0].peakBytes, 0u);
+    EXPECT_LE(stages[0].peakBytes, stages[0].bytes);
+    EXPECT_EQ(stages[2].allocations, 0u);
+    EXPECT_EQ(joined.second.allocations, stages[0].allocations + stages[3].allocations);
+    EXPECT_GE(joined.second.peakBytes, stages[0].peakBytes);
+}
+
+TEST(CppLinq, chromeTrace)
+{
+    std::vector<int> numbers;
+    for (int i = 0; i < 10000; i++)
+    {
+        numbers.push_back(i);
+    }
+    int digits[] = { 0, 1, 2 };
+
+    std::string path = testing::TempDir() + "cpplinq_trace.json";
+    {
+        zen::ChromeTrace trace(path);
+        auto result = FROM (numbers)
+            PARALLEL (2)
+            JOIN (digits) ON (o1 % 10 == o2)
+            SELECT2 (o1);
+        EXPECT_EQ(result.size(), 3000u);
+    }
+
+    std::ifstream in(path);
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(text.front(), '[');
+    EXPECT_NE(text.find("{\"name\":\"join\",\"cat\":\"cpplinq\",\"ph\":\"B\""), std::string::npos);
+    EXPECT_NE(text.find("\"args\":{\"engine\":\"blocked nested loop\",\"rows in\":10003,\"rows out\":3000}"), std::string::npos);
+    EXPECT_NE(text.find("\"name\":\"morsel\""), std::string::npos);
+    EXPECT_NE(text.find("\"name\":\"select\""), std::string::npos);
+    in.close();
+    std::remove(path.c_str());
+}
@@ -3,4 +3,5 @@
 import subprocess
 
 subprocess.call("./bin/cpplinq-unittest")
+subprocess.call("./bin/cpplinq-profile-unittest")
 
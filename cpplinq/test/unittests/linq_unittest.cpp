@@ -4,6 +4,10 @@
 #include "cpplinq.h"
 
 #include <list>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <fstream>
 
 TEST(CppLinq, basic)
 {
@@ -142,6 +146,67 @@ TEST(CppLinq, supportList)
     EXPECT_EQ(result, expectedResult);
 }
 
+TEST(CppLinq, unfiltered)
+{
+    std::vector<int> numbers = { 1, 2, 3, 4, 5 };
+    std::list<int> list = { 1, 2, 3, 4 };
+
+    auto query = FROM (numbers);
+    static_assert(std::is_same<decltype(query.begin()), std::vector<int>::iterator>::value, "no filter, no wrapper");
+    EXPECT_EQ(query.end() - query.begin(), 5);
+
+    EXPECT_EQ(FROM (numbers) COUNT (), 5u);
+    EXPECT_EQ(FROM (numbers) SKIP (2) COUNT (), 3u);
+    EXPECT_EQ(FROM (numbers) SKIP (9) COUNT (), 0u);
+    EXPECT_EQ(FROM (numbers) SKIP (1) TAKE (2) SUM (), 5);
+    EXPECT_EQ(FROM (numbers) SKIP (3) FIRST (), 4);
+    EXPECT_EQ(FROM (numbers) LAST (), 5);
+    EXPECT_EQ(FROM (list) SKIP (1) COUNT (), 3u);
+    EXPECT_EQ(FROM (list) LAST (), 4);
+}
+
+TEST(CppLinq, iteratorCategory)
+{
+    std::vector<int> numbers = { 1, 2, 3, 4, 5, 6 };
+    std::list<int> list = { 1, 2, 3, 4, 5, 6 };
+
+    EXPECT_EQ(FROM (numbers) SKIP (2) TAKE (3) LAST (), 5);
+    EXPECT_EQ(FROM (numbers) WHERE (o % 2 == 1) LAST (), 5);
+    EXPECT_EQ(FROM (numbers) WHERE (o % 2 == 1) TAKE (2) LAST (), 3);
+    EXPECT_EQ(FROM (list) WHERE (o % 2 == 0) LAST (), 6);
+    EXPECT_EQ(FROM (list) TAKE (4) LAST (), 4);
+
+    EXPECT_EQ(FROM (numbers) SKIP (1) ELEMENTAT (2), 4);
+    EXPECT_EQ(FROM (numbers) WHERE (o % 2 == 0) ELEMENTAT (1), 4);
+    EXPECT_EQ(FROM (list) SKIP (1) ELEMENTAT (4), 6);
+    EXPECT_THROW(FROM (numbers) TAKE (2) ELEMENTAT (2), std::out_of_range);
+    EXPECT_THROW(FROM (list) WHERE (o > 4) ELEMENTAT (2), std::out_of_range);
+
+    std::vector<int> empty;
+    EXPECT_THROW(FROM (empty) LAST (), std::out_of_range);
+    EXPECT_THROW(FROM (numbers) SKIP (6) LAST (), std::out_of_range);
+    EXPECT_THROW(FROM (numbers) WHERE (o > 9) LAST (), std::out_of_range);
+    EXPECT_THROW(FROM (list) SKIP (9) LAST (), std::out_of_range);
+    EXPECT_THROW(FROM (list) WHERE (o % 2 == 0) SKIP (3) LAST (), std::out_of_range);
+    EXPECT_THROW(FROM (list) TAKE (0) LAST (), std::out_of_range);
+
+    EXPECT_THROW(FROM (empty) FIRST (), std::out_of_range);
+    EXPECT_THROW(FROM (numbers) SKIP (6) FIRST (), std::out_of_range);
+    EXPECT_THROW(FROM (list) WHERE (o > 9) FIRST (), std::out_of_range);
+    EXPECT_THROW(FROM (numbers) TAKE (0) FIRST (), std::out_of_range);
+    EXPECT_THROW(FROM (numbers) JOIN (empty) ON (o1 == o2) FIRST (), std::out_of_range);
+    EXPECT_THROW(zen::fromGenerator([] { return std::optional<int>(); }) FIRST (), std::out_of_range);
+
+    auto odd = FROM (list) WHERE (o % 2 == 1);
+    static_assert(std::is_same<std::iterator_traits<decltype(odd.begin())>::iterator_category,
+        std::bidirectional_iterator_tag>::value, "a filter over a list stays bidirectional");
+    EXPECT_EQ(odd.end() - odd.begin(), 3u);
+    EXPECT_EQ(*(odd.end() - 2), 3);
+    EXPECT_EQ(*(odd.begin() + 1), 3);
+    EXPECT_TRUE(odd.begin() + 9 == odd.end());
+    EXPECT_EQ(*std::prev(odd.end()), 5);
+}
+
 TEST(CppLinq, join)
 {
     struct Record1
@@ -188,3 +253,923 @@ TEST(CppLinq, join)
     std::vector<std::tuple<int, int, int, int>> expectedResult2 = { { 5, 965, 93, 4 } };
     EXPECT_EQ(result2, expectedResult2);
 }
+
+TEST(CppLinq, rangeJoin)
+{
+    struct Event
+    {
+        int ts;
+        int user;
+    };
+
+    struct Session
+    {
+        int start;
+        int end;
+        int id;
+    };
+
+    Event events[] = { { 5, 1 }, { 12, 2 }, { 1, 3 }, { 20, 4 }, { 10, 5 } };
+    Session sessions[] = { { 0, 10, 100 }, { 10, 15, 200 }, { 4, 13, 300 } };
+
+    auto result1 = FROM (events)
+        RANGEJOIN (sessions, o1.ts, o2.start, o2.end)
+        SELECT2 (o1.user, o2.id);
+
+    auto expectedResult1 = FROM (events)
+        JOIN (sessions) ON (o1.ts >= o2.start && o1.ts < o2.end)
+        SELECT2 (o1.user, o2.id);
+
+    std::vector<std::tuple<int, int>> expectedResult2 = { { 1, 100 }, { 1, 300 }, { 2, 200 }, { 2, 300 }, { 3, 100 }, { 5, 200 }, { 5, 300 } };
+    EXPECT_EQ(result1, expectedResult1);
+    EXPECT_EQ(result1, expectedResult2);
+
+    Session windows[] = { { 0, 11, 7 } };
+
+    auto result2 = FROM (events)
+        RANGEJOIN (sessions, o1.ts, o2.start, o2.end)
+        RANGEJOIN2 (windows, o2.start, o3.start, o3.end)
+        SELECT3 (o1.user, o2.id, o3.id);
+
+    std::vector<std::tuple<int, int, int>> expectedResult3 = { { 1, 100, 7 }, { 1, 300, 7 }, { 2, 200, 7 }, { 2, 300, 7 }, { 3, 100, 7 }, { 5, 200, 7 }, { 5, 300, 7 } };
+    EXPECT_EQ(result2, expectedResult3);
+}
+
+TEST(CppLinq, asofJoin)
+{
+    struct Tick
+    {
+        int ts;
+        char symbol;
+    };
+
+    struct Quote
+    {
+        int ts;
+        char symbol;
+        int price;
+    };
+
+    Tick ticks[] = { { 3, 'a' }, { 10, 'b' }, { 1, 'a' }, { 7, 'a' }, { 12, 'a' } };
+    Quote quotes[] = { { 2, 'a', 100 }, { 5, 'b', 200 }, { 6, 'a', 101 }, { 9, 'b', 201 }, { 6, 'a', 102 } };
+
+    auto result1 = FROM (ticks)
+        ASOFJOIN (quotes, o1.ts, o2.ts)
+        SELECT2 (o1.ts, o2.price);
+
+    std::vector<std::tuple<int, int>> expectedResult1 = { { 3, 100 }, { 10, 201 }, { 7, 102 }, { 12, 201 } };
+    EXPECT_EQ(result1, expectedResult1);
+
+    auto result2 = FROM (ticks)
+        ASOFJOINBY (quotes, o1.ts, o2.ts, o1.symbol, o2.symbol)
+        SELECT2 (o1.ts, o2.price);
+
+    std::vector<std::tuple<int, int>> expectedResult2 = { { 3, 100 }, { 10, 201 }, { 7, 102 }, { 12, 102 } };
+    EXPECT_EQ(result2, expectedResult2);
+
+    auto result3 = FROM (ticks)
+        ASOFJOINBY (quotes, o1.ts, o2.ts, o1.symbol, o2.symbol, 2)
+        SELECT2 (o1.ts, o2.price);
+
+    std::vector<std::tuple<int, int>> expectedResult3 = { { 3, 100 }, { 10, 201 }, { 7, 102 } };
+    EXPECT_EQ(result3, expectedResult3);
+
+    // A condition on the quote runs on the matches: removing quotes first
+    // would pair ticks with older quotes instead of dropping them.
+    auto expectedResult4 = FROM (ticks)
+        ASOFJOIN (quotes, o1.ts, o2.ts)
+        WHERE2 (o2.price < 200)
+        SELECT2 (o1.ts, o2.price);
+
+    std::vector<std::tuple<int, int>> expectedRows4 = { { 3, 100 }, { 7, 102 } };
+    EXPECT_EQ(expectedResult4, expectedRows4);
+
+    auto result4 = FROM (ticks)
+        ASOFJOIN (quotes, o1.ts, o2.ts)
+        .where(zen::col<2>(&Quote::price) < 200)
+        SELECT2 (o1.ts, o2.price);
+    EXPECT_EQ(result4, expectedResult4);
+
+    auto result5 = FROM (ticks)
+        ASOFJOIN (quotes, o1.ts, o2.ts)
+        WHERERIGHT (o2.price < 200)
+        SELECT2 (o1.ts, o2.price);
+    EXPECT_EQ(result5, expectedResult4);
+}
+
+TEST(CppLinq, blockedJoin)
+{
+    struct Point
+    {
+        int x;
+        int y;
+    };
+
+    std::vector<Point> points1;
+    std::vector<Point> points2;
+    for (int i = 0; i < 2500; i++)
+    {
+        points1.push_back({ i % 97, i % 89 });
+        points2.push_back({ i % 83, i % 79 });
+    }
+
+    std::vector<std::tuple<int, int, int, int>> expectedResult;
+    for (const auto& p1 : points1)
+    {
+        for (const auto& p2 : points2)
+        {
+            if (std::abs(p1.x - p2.x) + std::abs(p1.y - p2.y) < 3)
+                expectedResult.push_back({ p1.x, p1.y, p2.x, p2.y });
+        }
+    }
+
+    auto result1 = FROM (points1)
+        JOIN (points2) ON (std::abs(o1.x - o2.x) + std::abs(o1.y - o2.y) < 3)
+        SELECT2 (o1.x, o1.y, o2.x, o2.y);
+
+    auto result2 = FROM (points1)
+        PARALLEL (4)
+        JOIN (points2) ON (std::abs(o1.x - o2.x) + std::abs(o1.y - o2.y) < 3)
+        SELECT2 (o1.x, o1.y, o2.x, o2.y);
+
+    EXPECT_EQ(result1, expectedResult);
+    EXPECT_EQ(result2, expectedResult);
+}
+
+TEST(CppLinq, join3)
+{
+    int numbers[] = { 1, 2, 3, 4, 5, 6 };
+
+    auto result = FROM (numbers)
+        WHERE (o % 2 == 0)
+        JOIN (numbers) ON (o2 == o1 + 1)
+        JOIN2 (numbers) ON (o3 == o2 + 1)
+        JOIN3 (numbers) ON (o4 == o3 + 1)
+        SELECT4 (o1, o2, o3, o4);
+
+    std::vector<std::tuple<int, int, int, int>> expectedResult = { { 2, 3, 4, 5 } };
+    EXPECT_EQ(result, expectedResult);
+}
+
+TEST(CppLinq, hashJoin)
+{
+    struct Record1
+    {
+        int x;
+        int y;
+    };
+
+    struct Record2
+    {
+        int a;
+        int b;
+    };
+
+    Record1 records1[] = { { 1, 100 }, { 2, 200 }, { 1, 300 }, { 5, 341 }, { 5, 400 }, { 5, 965 } };
+    Record2 records2[] = { { 1, 3 }, { 3, 44 }, { 5, 93 }, { 1, 4 } };
+
+    auto expectedResult = FROM (records1)
+        JOIN (records2) ON (o1.x == o2.a)
+        SELECT2 (o1.x, o1.y, o2.b);
+
+    auto result1 = FROM (records1)
+        HASHJOIN (records2, o1.x, o2.a)
+        SELECT2 (o1.x, o1.y, o2.b);
+
+    auto result2 = FROM (records1)
+        HASHJOIN (records2, o1.x, o2.a, BLOOM_FILTER)
+        SELECT2 (o1.x, o1.y, o2.b);
+
+    EXPECT_EQ(result1, expectedResult);
+    EXPECT_EQ(result2, expectedResult);
+}
+
+TEST(CppLinq, bloomFilter)
+{
+    std::vector<int> keys;
+    for (int i = 0; i < 1000; i++)
+    {
+        keys.push_back(i * 7);
+    }
+
+    auto filter = FROM (keys)
+        WHERE (o % 2 == 0)
+        .bloomFilter([](const auto& o) { return o; });
+
+    int falsePositives = 0;
+    for (int i = 0; i < 7000; i++)
+    {
+        if (i % 14 == 0)
+            EXPECT_TRUE(filter.mayContain(i));
+        else if (filter.mayContain(i))
+            falsePositives++;
+    }
+    EXPECT_LT(falsePositives, 100);
+
+    auto result = FROM (keys)
+        .where([&](const auto& o) { return filter.mayContain(o); })
+        COUNT();
+
+    EXPECT_GE(result, 500);
+
+    auto firstTen = FROM (keys)
+        TAKE (10)
+        .bloomFilter([](const auto& o) { return o; });
+
+    falsePositives = 0;
+    for (int i = 10; i < 1000; i++)
+    {
+        if (firstTen.mayContain(i * 7))
+            falsePositives++;
+    }
+    EXPECT_TRUE(firstTen.mayContain(63));
+    EXPECT_LT(falsePositives, 100);
+}
+
+TEST(CppLinq, radixHashJoin)
+{
+    struct Order
+    {
+        int id;
+        int customer;
+    };
+
+    struct Customer
+    {
+        int id;
+        int region;
+    };
+
+    std::vector<Order> orders;
+    std::vector<Customer> customers;
+    for (int i = 0; i < 50000; i++)
+    {
+        orders.push_back({ i, (i * 7919) % 60000 });
+        customers.push_back({ i, i % 13 });
+    }
+
+    auto expectedResult = FROM (orders)
+        HASHJOIN (customers, o1.customer, o2.id)
+        SELECT2 (o1.id, o2.region);
+
+    auto result1 = FROM (orders)
+        HASHJOIN (customers, o1.customer, o2.id, RADIX_PARTITION)
+        SELECT2 (o1.id, o2.region);
+
+    auto result2 = FROM (orders)
+        PARALLEL (4)
+        HASHJOIN (customers, o1.customer, o2.id, RADIX_PARTITION | BLOOM_FILTER)
+        SELECT2 (o1.id, o2.region);
+
+    EXPECT_GT(expectedResult.size(), 0u);
+    EXPECT_EQ(result1, expectedResult);
+    EXPECT_EQ(result2, expectedResult);
+}
+
+TEST(CppLinq, hashJoinKeyTypes)
+{
+    long long wide[] = { (1LL << 32) + 5, 5, -1 };
+    int dense[] = { 5, 6 };
+    int sparse[] = { 5, 1000000000 };
+
+    auto expectedResult = FROM (wide) JOIN (dense) ON (o1 == o2) SELECT2 (o1, o2);
+    std::vector<std::tuple<long long, int>> expectedRows = { { 5, 5 } };
+    EXPECT_EQ(expectedResult, expectedRows);
+
+    EXPECT_EQ(FROM (wide) HASHJOIN (dense, o1, o2) SELECT2 (o1, o2), expectedResult);
+    EXPECT_EQ(FROM (wide) HASHJOIN (dense, o1, o2, DIRECT_ADDRESS) SELECT2 (o1, o2), expectedResult);
+    EXPECT_EQ(FROM (wide) HASHJOIN (sparse, o1, o2) SELECT2 (o1, o2), expectedResult);
+    EXPECT_EQ(FROM (wide) HASHJOIN (sparse, o1, o2, RADIX_PARTITION) SELECT2 (o1, o2), expectedResult);
+    EXPECT_EQ(FROM (wide) HASHJOIN (sparse, o1, o2, RADIX_PARTITION | BLOOM_FILTER) SELECT2 (o1, o2), expectedResult);
+}
+
+TEST(CppLinq, directAddressJoin)
+{
+    struct Sale
+    {
+        int product;
+        int amount;
+    };
+
+    struct Product
+    {
+        int id;
+        int category;
+    };
+
+    std::vector<Sale> sales = { { 3, 10 }, { 1, 20 }, { 7, 30 }, { 3, 40 }, { -2, 50 }, { 1000, 60 } };
+    std::vector<Product> products = { { 1, 100 }, { 2, 200 }, { 3, 300 }, { 3, 301 }, { 7, 700 } };
+
+    auto expectedResult = FROM (sales)
+        JOIN (products) ON (o1.product == o2.id)
+        SELECT2 (o1.amount, o2.category);
+
+    auto result1 = FROM (sales)
+        HASHJOIN (products, o1.product, o2.id)
+        SELECT2 (o1.amount, o2.category);
+
+    auto result2 = FROM (sales)
+        HASHJOIN (products, o1.product, o2.id, DIRECT_ADDRESS)
+        SELECT2 (o1.amount, o2.category);
+
+    EXPECT_EQ(result1, expectedResult);
+    EXPECT_EQ(result2, expectedResult);
+}
+
+TEST(CppLinq, groupBy)
+{
+    struct Sale
+    {
+        int region;
+        int amount;
+    };
+
+    Sale sales[] = { { 3, 10 }, { 1, 20 }, { 3, 30 }, { 2, 40 }, { 1, 50 } };
+
+    auto result1 = FROM (sales)
+        WHERE (o.amount > 10)
+        GROUPBY (o.region, 0, acc += o.amount);
+
+    std::vector<std::pair<int, int>> expectedResult1 = { { 1, 70 }, { 3, 30 }, { 2, 40 } };
+    EXPECT_EQ(result1, expectedResult1);
+
+    std::string names[] = { "b", "a", "b", "c", "b" };
+
+    auto result2 = FROM (names)
+        GROUPBY (o, 0, acc++);
+
+    std::vector<std::pair<std::string, int>> expectedResult2 = { { "b", 3 }, { "a", 1 }, { "c", 1 } };
+    EXPECT_EQ(result2, expectedResult2);
+
+    auto result3 = FROM (sales)
+        SKIP (1)
+        TAKE (2)
+        GROUPBY (o.region, 0, acc += o.amount);
+
+    std::vector<std::pair<int, int>> expectedResult3 = { { 1, 20 }, { 3, 30 } };
+    EXPECT_EQ(result3, expectedResult3);
+}
+
+TEST(CppLinq, columns)
+{
+    struct Record
+    {
+        int x;
+        int y;
+        double z;
+    };
+
+    std::vector<Record> records = { { 1, 10, 0.5 }, { 2, 12, 1.5 }, { 3, 11, 2.5 }, { 4, 13, 3.5 }, { 6, 9, 4.5 } };
+    auto table = zen::toColumns(records.begin(), records.end(), &Record::x, &Record::y, &Record::z);
+
+    EXPECT_EQ(table.size(), 5u);
+    EXPECT_EQ(table.column<1>()[2], 11);
+
+    auto result1 = FROM_COLUMNS (table)
+        WHERE3 (o1 % 2 == 0)
+        ORDERBY3 (o2, DESCEND)
+        SELECT3 (o1, o3);
+
+    std::vector<std::tuple<int, double>> expectedResult1 = { { 4, 3.5 }, { 2, 1.5 }, { 6, 4.5 } };
+    EXPECT_EQ(result1, expectedResult1);
+
+    zen::ColumnTable<int, int> table2;
+    for (int i = 0; i < 10; i++)
+    {
+        table2.addRow(i, i * i);
+    }
+
+    auto result2 = FROM_COLUMNS (table2)
+        WHERE2 (o2 > 10)
+        SKIP (2)
+        TAKE (3)
+        SELECT2 (o1);
+
+    std::vector<std::tuple<int>> expectedResult2 = { { 6 }, { 7 }, { 8 } };
+    EXPECT_EQ(result2, expectedResult2);
+
+    auto result3 = FROM_COLUMNS (table2)
+        WHERE2 (o1 > 2)
+        WHERE2 (o1 < 8)
+        COUNT();
+
+    EXPECT_EQ(result3, 5u);
+}
+
+TEST(CppLinq, batched)
+{
+    std::vector<int> numbers;
+    for (int i = 0; i < 10000; i++)
+    {
+        numbers.push_back((i * 37) % 1000);
+    }
+
+    std::vector<std::tuple<int>> expectedResult1;
+    int expectedSum = 0;
+    size_t expectedCount = 0;
+    int skipped = 0;
+    for (int n : numbers)
+    {
+        if (n % 3 != 0)
+            continue;
+        expectedSum += n;
+        expectedCount++;
+        if (skipped++ >= 1500 && expectedResult1.size() < 2000)
+            expectedResult1.push_back({ n * 2 });
+    }
+
+    auto result1 = FROM (numbers)
+        WHERE (o % 3 == 0)
+        SKIP (1500)
+        TAKE (2000)
+        SELECT (o * 2);
+
+    EXPECT_EQ(result1, expectedResult1);
+
+    auto result2 = FROM (numbers)
+        WHERE (o % 3 == 0)
+        SUM();
+
+    EXPECT_EQ(result2, expectedSum);
+
+    auto result3 = FROM (numbers)
+        WHERE (o % 3 == 0)
+        COUNT();
+
+    EXPECT_EQ(result3, expectedCount);
+
+    auto result4 = FROM (numbers)
+        WHERE (o % 3 == 0)
+        AVERAGE();
+
+    EXPECT_EQ(result4, expectedSum / (int)expectedCount);
+}
+
+TEST(CppLinq, expression)
+{
+    struct Record1
+    {
+        int x;
+        int y;
+    };
+
+    struct Record2
+    {
+        int a;
+        int b;
+    };
+
+    using zen::col;
+
+    std::vector<Record1> records1 = { { 1, 10 }, { 2, 12 }, { 3, 12 }, { 4, 13 }, { 6, 12 } };
+    Record2 records2[] = { { 2, 7 }, { 6, 8 }, { 4, 9 } };
+
+    auto condition = col(&Record1::x) % 2 == 0 && !(col(&Record1::y) != 12);
+    static_assert(zen::IsExpression<decltype(condition)>::value, "condition is an expression");
+    static_assert(decltype(condition)::inputs == 1, "condition reads the first input only");
+
+    auto result1 = FROM (records1)
+        .where(condition)
+        .orderBy(col(&Record1::x), DESCEND)
+        .select(col(&Record1::x) * 10 + col(&Record1::y));
+
+    std::vector<int> expectedResult1 = { 72, 32 };
+    EXPECT_EQ(result1, expectedResult1);
+
+    auto joinCondition = col<1>(&Record1::x) == col<2>(&Record2::a);
+    static_assert(decltype(joinCondition)::inputs == 3, "join condition reads both inputs");
+
+    auto result2 = FROM (records1)
+        .join(std::begin(records2), std::end(records2), joinCondition)
+        .where(col<2>(&Record2::b) > 7)
+        .select(col<1>(&Record1::y) - col<2>(&Record2::b));
+
+    std::vector<int> expectedResult2 = { 4, 4 };
+    EXPECT_EQ(result2, expectedResult2);
+}
+
+TEST(CppLinq, predicatePushdown)
+{
+    struct Record1
+    {
+        int x;
+        int y;
+    };
+
+    struct Record2
+    {
+        int a;
+        int b;
+    };
+
+    using zen::col;
+
+    Record1 records1[] = { { 1, 100 }, { 2, 200 }, { 1, 300 }, { 5, 341 }, { 5, 400 }, { 5, 965 } };
+    Record2 records2[] = { { 1, 3 }, { 3, 44 }, { 5, 93 } };
+
+    int evaluations = 0;
+    auto condition = [&](const Record1& o1, const Record2& o2) {
+        evaluations++;
+        return o1.x == o2.a;
+    };
+
+    auto result1 = FROM (records1)
+        .join(std::begin(records2), std::end(records2), condition)
+        .where(col<1>(&Record1::y) % 100 == 0)
+        .where(col<2>(&Record2::b) < 50)
+        SELECT2 (o1.x, o1.y, o2.b);
+
+    std::vector<std::tuple<int, int, int>> expectedResult1 = { { 1, 100, 3 }, { 1, 300, 3 } };
+    EXPECT_EQ(result1, expectedResult1);
+    EXPECT_EQ(evaluations, 4 * 2);
+
+    evaluations = 0;
+    auto result2 = FROM (records1)
+        .join(std::begin(records2), std::end(records2), condition)
+        WHERELEFT (o1.y % 100 == 0)
+        WHERERIGHT (o2.b > 50)
+        SELECT2 (o1.x, o1.y, o2.b);
+
+    std::vector<std::tuple<int, int, int>> expectedResult2 = { { 5, 400, 93 } };
+    EXPECT_EQ(result2, expectedResult2);
+    EXPECT_EQ(evaluations, 4 * 1);
+
+    Record2 records3[] = { { 93, 1 }, { 3, 2 } };
+
+    auto result3 = FROM (records1)
+        JOIN (records2) ON (o1.x == o2.a)
+        JOIN2 (records3) ON (o2.b == o3.a)
+        .where(col<1>(&Record1::y) > 300 && col<3>(&Record2::b) == 1)
+        SELECT3 (o1.y, o3.b);
+
+    std::vector<std::tuple<int, int>> expectedResult3 = { { 341, 1 }, { 400, 1 }, { 965, 1 } };
+    EXPECT_EQ(result3, expectedResult3);
+}
+
+TEST(CppLinq, limitPushdown)
+{
+    std::vector<int> numbers;
+    for (int i = 0; i < 10000; i++)
+    {
+        numbers.push_back(i);
+    }
+    int digits[] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 };
+
+    int evaluations = 0;
+    auto condition = [&](int o1, int o2) {
+        evaluations++;
+        return o1 % 10 == o2;
+    };
+
+    auto result1 = FROM (numbers)
+        .join(std::begin(digits), std::end(digits), condition)
+        SKIP (2)
+        TAKE (3)
+        SELECT2 (o1, o2);
+
+    std::vector<std::tuple<int, int>> expectedResult1 = { { 2, 2 }, { 3, 3 }, { 4, 4 } };
+    EXPECT_EQ(result1, expectedResult1);
+    EXPECT_LT(evaluations, 10000 * 10);
+
+    int keys = 0;
+    auto result2 = FROM (numbers)
+        .hashJoin(std::begin(digits), std::end(digits), [&](int o1) { keys++; return o1 / 1000; }, [](int o2) { return o2; })
+        WHERE2 (o1 % 2 == 1)
+        TAKE (2)
+        SELECT2 (o1, o2);
+
+    std::vector<std::tuple<int, int>> expectedResult2 = { { 1, 0 }, { 3, 0 } };
+    EXPECT_EQ(result2, expectedResult2);
+    EXPECT_EQ(keys, 4);
+
+    auto result3 = FROM (numbers)
+        JOIN (digits) ON (o1 % 10 == o2)
+        TAKE (4)
+        WHERE2 (o2 % 2 == 0)
+        SELECT2 (o1);
+
+    std::vector<std::tuple<int>> expectedResult3 = { { 0 }, { 2 } };
+    EXPECT_EQ(result3, expectedResult3);
+
+    auto result4 = FROM (numbers)
+        JOIN (digits) ON (o1 % 10 == o2)
+        SKIP (5)
+        WHERELEFT (o1 % 2 == 0)
+        TAKE (2)
+        SELECT2 (o1);
+
+    std::vector<std::tuple<int>> expectedResult4 = { { 6 }, { 8 } };
+    EXPECT_EQ(result4, expectedResult4);
+
+    auto result5 = FROM (numbers) JOIN (digits) ON (o1 % 10 == o2) WHERE2 (o1 > 5) FIRST ();
+    EXPECT_EQ(result5.var1, 6);
+    EXPECT_EQ(FROM (numbers) JOIN (digits) ON (o1 % 10 == o2) COUNT (), 10000);
+
+    EXPECT_EQ(FROM (numbers) WHERE (o % 3 == 0) SKIP (1) TAKE (3) COUNT (), 3);
+    EXPECT_EQ(FROM (numbers) WHERE (o % 3 == 0) SKIP (1) TAKE (3) SUM (), 3 + 6 + 9);
+
+    auto result6 = FROM (numbers) JOIN (digits) ON (o1 % 10 == o2) TAKE (10) SKIP (5) SELECT2 (o1);
+    auto expectedResult6 = FROM (numbers) TAKE (10) SKIP (5) SELECT (o);
+    EXPECT_EQ(result6.size(), 10u);
+    EXPECT_EQ(result6, expectedResult6);
+    EXPECT_EQ(FROM (numbers) JOIN (digits) ON (o1 % 10 == o2) TAKE (10) SKIP (5) COUNT (), 10u);
+
+    EXPECT_EQ(FROM (numbers) JOIN (digits) ON (o1 % 10 == o2) SKIP (2) SKIP (3) FIRST ().var1,
+        FROM (numbers) SKIP (2) SKIP (3) FIRST ());
+    EXPECT_EQ(FROM (numbers) TAKE (3) JOIN (digits) ON (o1 == o2) COUNT (), 3u);
+    EXPECT_EQ(FROM (numbers) SKIP (6) TAKE (3) JOIN (digits) ON (o1 == o2) SELECT2 (o1).size(), 3u);
+    EXPECT_EQ(FROM (numbers) TAKE (3) JOIN (digits) ON (o1 % 10 == o2) WHERELEFT (o1 > 0) COUNT (), 2u);
+}
+
+TEST(CppLinq, projection)
+{
+    struct Record1
+    {
+        Record1(int x, int y, int* copies) : x(x), y(y), copies(copies) {}
+        Record1(const Record1& other) : x(other.x), y(other.y), copies(other.copies) { (*copies)++; }
+
+        int x;
+        int y;
+        int* copies;
+    };
+
+    struct Record2
+    {
+        int a;
+        int b;
+    };
+
+    using zen::col;
+
+    int copies = 0;
+    std::vector<Record1> records1 = { { 1, 100, &copies }, { 2, 200, &copies }, { 1, 300, &copies }, { 5, 341, &copies } };
+    Record2 records2[] = { { 1, 3 }, { 3, 44 }, { 5, 93 } };
+    copies = 0;
+
+    auto result1 = FROM (records1)
+        JOIN (records2) ON (o1.x == o2.a)
+        .select(&Record1::y, &Record2::b);
+
+    std::vector<std::tuple<int, int>> expectedResult1 = { { 100, 3 }, { 300, 3 }, { 341, 93 } };
+    EXPECT_EQ(result1, expectedResult1);
+    EXPECT_EQ(copies, 0);
+
+    auto result2 = FROM (records1)
+        JOIN (records2) ON (o1.x == o2.a)
+        .select(col<1>(&Record1::y) + col<2>(&Record2::b), &Record2::a);
+
+    std::vector<std::tuple<int, int>> expectedResult2 = { { 103, 1 }, { 303, 1 }, { 434, 5 } };
+    EXPECT_EQ(result2, expectedResult2);
+    EXPECT_EQ(copies, 0);
+
+    auto result3 = FROM (records1)
+        WHERE (o.x == 1)
+        .select(&Record1::y);
+
+    std::vector<std::tuple<int>> expectedResult3 = { { 100 }, { 300 } };
+    EXPECT_EQ(result3, expectedResult3);
+
+    auto result4 = FROM (records2)
+        JOIN (records2) ON (o1.a + 2 == o2.a)
+        .select(col<1>(&Record2::b), col<2>(&Record2::b));
+
+    std::vector<std::tuple<int, int>> expectedResult4 = { { 3, 44 }, { 44, 93 } };
+    EXPECT_EQ(result4, expectedResult4);
+}
+
+TEST(CppLinq, mappedFile)
+{
+    struct Record
+    {
+        int x;
+        int y;
+    };
+
+    std::string path = testing::TempDir() + "cpplinq_mapped_file.bin";
+    {
+        std::ofstream out(path, std::ios::binary);
+        for (int i = 0; i < 5000; i++)
+        {
+            Record record = { i, i * 2 };
+            out.write(reinterpret_cast<const char*>(&record), sizeof(record));
+        }
+    }
+
+    auto result1 = zen::fromMappedFile<Record>(path)
+        WHERE (o.x % 1000 == 0)
+        SELECT (o.x, o.y);
+
+    std::vector<std::tuple<int, int>> expectedResult1 = { { 0, 0 }, { 1000, 2000 }, { 2000, 4000 }, { 3000, 6000 }, { 4000, 8000 } };
+    EXPECT_EQ(result1, expectedResult1);
+
+    auto query = zen::fromMappedFile<Record>(path) WHERE (o.y > 9990);
+    EXPECT_EQ(query.count(), 4);
+
+    {
+        zen::MappedFile<Record> file(path);
+        EXPECT_EQ(file.size(), 5000u);
+        EXPECT_EQ(FROM (file) SKIP (10) FIRST ().y, 20);
+    }
+
+    std::remove(path.c_str());
+    EXPECT_THROW(zen::fromMappedFile<Record>(path), std::runtime_error);
+}
+
+TEST(CppLinq, csv)
+{
+    std::string path = testing::TempDir() + "cpplinq_csv.csv";
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << "id,name,price\n";
+        for (int i = 0; i < 100000; i++)
+        {
+            out << i << ",item" << i << "," << (i % 100) * 0.5 << "\r\n";
+        }
+        out << "100000,last,99.5";
+    }
+
+    zen::CsvSchema<int, std::string_view, double> schema;
+
+    auto result1 = zen::fromCsv(path, schema)
+        WHERE (zen::get<0>(o) % 25000 == 0 || zen::get<2>(o) > 49.5)
+        SELECT (zen::get<0>(o), std::string(zen::get<1>(o)));
+
+    std::vector<std::tuple<int, std::string>> expectedResult1 = { { 0, "item0" }, { 25000, "item25000" },
+        { 50000, "item50000" }, { 75000, "item75000" }, { 100000, "last" } };
+    EXPECT_EQ(result1, expectedResult1);
+
+    EXPECT_EQ(zen::fromCsv(path, schema) COUNT (), 100001u);
+    EXPECT_EQ(zen::get<1>(zen::fromCsv(path, schema) SKIP (7) FIRST ()), "item7");
+
+    auto lazy = zen::fromCsv(path, schema);
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << "id,name,price\n7,seven,1\n";
+    }
+    EXPECT_EQ(lazy COUNT (), 1u);
+
+    {
+        std::ofstream out(path, std::ios::binary);
+        out << "id,name,price\n1,a,0.5\n\n2,b,1.5x\n3,c,2\n";
+    }
+    try
+    {
+        zen::fromCsv(path, schema) SELECT (zen::get<2>(o));
+        FAIL() << "a malformed field is not reported";
+    }
+    catch (const std::runtime_error& e)
+    {
+        EXPECT_STREQ(e.what(), "cpplinq: cannot parse \"1.5x\" at line 4, column 3");
+    }
+    EXPECT_THROW(zen::fromCsv(path, schema) WHERE (zen::get<2>(o) > 1.0) COUNT (), std::runtime_error);
+    EXPECT_EQ(zen::fromCsv(path, schema) WHERE (zen::get<0>(o) > 0) SELECT (zen::get<0>(o)).size(), 3u);
+
+    std::remove(path.c_str());
+    EXPECT_THROW(zen::fromCsv(path, schema), std::runtime_error);
+}
+
+TEST(CppLinq, generator)
+{
+    int pulls = 0;
+    auto naturals = [&pulls, i = 0]() mutable -> std::optional<int> {
+        pulls++;
+        return i++;
+    };
+
+    auto result1 = zen::fromGenerator(naturals)
+        WHERE (o % 3 == 0)
+        TAKE (4)
+        SELECT (o);
+
+    std::vector<std::tuple<int>> expectedResult1 = { { 0 }, { 3 }, { 6 }, { 9 } };
+    EXPECT_EQ(result1, expectedResult1);
+    EXPECT_EQ(pulls, 10);
+
+    pulls = 0;
+    EXPECT_EQ(zen::fromGenerator(naturals) WHERE (o > 100) FIRST (), 101);
+    EXPECT_EQ(pulls, 102);
+
+    pulls = 0;
+    EXPECT_TRUE(zen::fromGenerator(naturals) WHERE (o == 42) ANY ());
+    EXPECT_EQ(pulls, 43);
+
+    pulls = 0;
+    auto positive = zen::fromGenerator(naturals) WHERE (o > 0);
+    EXPECT_EQ(pulls, 0);
+    EXPECT_EQ(positive FIRST (), 1);
+    EXPECT_EQ(pulls, 2);
+
+    pulls = 0;
+    EXPECT_EQ(zen::fromGenerator(naturals) TAKE (0) COUNT (), 0u);
+    EXPECT_EQ(pulls, 0);
+
+    auto countdown = [i = 5]() mutable -> std::optional<int> {
+        if (i == 0)
+            return std::nullopt;
+        return i--;
+    };
+    EXPECT_EQ(zen::fromGenerator(countdown) SUM (), 15);
+    EXPECT_FALSE(zen::fromGenerator(countdown) WHERE (o > 5) ANY ());
+}
+
+#ifdef CPPLINQ_HAS_COROUTINES
+zen::Generator<int> three()
+{
+    for (int i = 1; i <= 3; i++)
+    {
+        co_yield i;
+    }
+}
+
+TEST(CppLinq, coroutine)
+{
+    auto query = zen::fromGenerator(three());
+    EXPECT_EQ(query COUNT (), 3u);
+    EXPECT_EQ(query COUNT (), 0u);
+    EXPECT_EQ(zen::fromGenerator(three()) WHERE (o > 1) SUM (), 5);
+}
+#endif
+
+TEST(CppLinq, singlePass)
+{
+    auto upToFive = [i = 0]() mutable -> std::optional<int> {
+        if (i == 5)
+            return std::nullopt;
+        return i++;
+    };
+    int digits[] = { 0, 1, 2, 3, 4 };
+
+    auto result1 = zen::fromGenerator(upToFive)
+        JOIN (digits) ON (o1 == o2)
+        SELECT2 (o1, o2);
+
+    std::vector<std::tuple<int, int>> expectedResult1 = { { 0, 0 }, { 1, 1 }, { 2, 2 }, { 3, 3 }, { 4, 4 } };
+    EXPECT_EQ(result1, expectedResult1);
+
+    auto result2 = zen::fromGenerator(upToFive)
+        GROUPBY (o % 2, 0, acc += o);
+
+    std::vector<std::pair<int, int>> expectedResult2 = { { 0, 6 }, { 1, 4 } };
+    EXPECT_EQ(result2, expectedResult2);
+
+    auto result3 = zen::fromGenerator(upToFive)
+        TAKE (2)
+        GROUPBY (o % 2, 0, acc += o);
+
+    std::vector<std::pair<int, int>> expectedResult3 = { { 0, 0 }, { 1, 1 } };
+    EXPECT_EQ(result3, expectedResult3);
+}
+
+TEST(CppLinq, runAsync)
+{
+    std::vector<int> numbers;
+    for (int i = 0; i < 100000; i++)
+    {
+        numbers.push_back(i);
+    }
+
+    auto future1 = FROM (numbers)
+        WHERE (o % 2 == 0)
+        .runAsync([](auto& q) { return q COUNT (); });
+    EXPECT_EQ(future1.get(), 50000u);
+
+    int digits[] = { 0, 1, 2 };
+    auto future2 = FROM (numbers)
+        JOIN (digits) ON (o1 % 10 == o2)
+        .runAsync([](auto& q) { return q SELECT2 (o1 + o2); });
+    EXPECT_EQ(future2.get().size(), 30000u);
+
+    zen::CancellationToken token;
+    token.cancel();
+    auto future3 = FROM (numbers)
+        WHERE (o % 2 == 0)
+        .runAsync([](auto& q) { return q SELECT (o); }, token);
+    EXPECT_THROW(future3.get(), zen::QueryCancelled);
+
+    auto naturals = [i = 0]() mutable -> std::optional<int> { return i++; };
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(20);
+    auto future4 = zen::fromGenerator(naturals)
+        .runAsync([](auto& q) { return q COUNT (); }, zen::CancellationToken(), deadline);
+    EXPECT_THROW(future4.get(), zen::QueryCancelled);
+}
+
+TEST(CppLinq, explain)
+{
+    std::vector<int> numbers;
+    for (int i = 0; i < 10000; i++)
+    {
+        numbers.push_back(i);
+    }
+    int digits[] = { 0, 1, 2 };
+
+    std::string plan1 = FROM (numbers) WHERE (o % 2 == 0) TAKE (5) .explain();
+    EXPECT_EQ(plan1, "from: random-access range of 10000 rows\nwhere: batched selection vectors\ntake: 5\n");
+
+    std::string plan2 = FROM (numbers)
+        HASHJOIN (digits, o1 % 10, o2)
+        WHERERIGHT (o2 > 0)
+        WHERE2 (o1 > o2)
+        .explain();
+    EXPECT_EQ(plan2, "from: random-access range of 10000 rows\nwhere: pushed below the join into its right input\n"
+        "join: hash join\nwhere: checked on each match\n");
+}